@@ -0,0 +1,173 @@
+// checks Conv2d and UpsampleConv2d, on both the winograd and the im2col path, against a direct convolution in long
+// double: the output of forward, and the grads of backward against finite differences of the direct convolution.
+// every case runs once with the default workspace and once with a workspace of one row or picture, so the chunked
+// passes and col2im are covered too.
+//
+//   convolutionCheck
+//
+// prints the largest errors of every case and exits with 1 if any is over the tolerance, which is how ctest runs it
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "mygrad/mygrad.hpp"
+
+using namespace mygrad;
+
+static std::mt19937 generator(0);
+
+// errors relative to 1 + the magnitude of the expected value
+static constexpr double TOLERANCE = sizeof(dtype) == sizeof(float) ? 1e-4 : 1e-7;
+static constexpr long double STEP = 1e-6L; // of the central differences
+
+struct Case {
+    const char* name;
+    size_t upsampling, pictures, inChannels, height, width, outChannels, kernelSize, stride, padding;
+    Activation activation;
+};
+
+// a direct convolution of the input upsampled by repeating every pixel, as a loss: the sum of the outputs weighted
+// by outputWeights, which makes outputWeights the grads of the output
+struct DirectConvolution {
+    const Case& shape;
+    std::vector<long double> input, kernels, biases, outputWeights;
+
+    size_t outputHeight() const { return (shape.height * shape.upsampling + 2 * shape.padding - shape.kernelSize) / shape.stride + 1; }
+    size_t outputWidth() const { return (shape.width * shape.upsampling + 2 * shape.padding - shape.kernelSize) / shape.stride + 1; }
+
+    // the outputs, and for relu which pre-activations are positive, so a difference across the kink can be left out
+    long double loss( std::vector<long double>* outputs = nullptr, std::vector<bool>* positive = nullptr ) const {
+        const Case& s = shape;
+        const size_t rows = outputHeight(), cols = outputWidth();
+        const long double upsampledRows = s.height * s.upsampling, upsampledCols = s.width * s.upsampling;
+        long double loss = 0;
+        size_t index = 0;
+        for (size_t picture = 0; picture < s.pictures; picture++) {
+            for (size_t out = 0; out < s.outChannels; out++) {
+                for (size_t row = 0; row < rows; row++) {
+                    for (size_t col = 0; col < cols; col++, index++) {
+                        long double sum = biases[out];
+                        for (size_t in = 0; in < s.inChannels; in++) {
+                            for (size_t i = 0; i < s.kernelSize; i++) {
+                                for (size_t j = 0; j < s.kernelSize; j++) {
+                                    const long double r = static_cast<long double>(row * s.stride + i) - s.padding;
+                                    const long double c = static_cast<long double>(col * s.stride + j) - s.padding;
+                                    if (r < 0 or c < 0 or r >= upsampledRows or c >= upsampledCols) continue;
+                                    const size_t sourceRow = static_cast<size_t>(r) / s.upsampling, sourceCol = static_cast<size_t>(c) / s.upsampling;
+                                    sum += kernels[((out * s.inChannels + in) * s.kernelSize + i) * s.kernelSize + j]
+                                         * input[((picture * s.inChannels + in) * s.height + sourceRow) * s.width + sourceCol];
+                                }
+                            }
+                        }
+                        if (positive) positive->push_back(sum > 0);
+                        if (s.activation == Activation::ReLU) sum = sum > 0 ? sum : 0;
+                        if (s.activation == Activation::Sigmoid) sum = 1 / (1 + std::exp(-sum));
+                        if (outputs) outputs->push_back(sum);
+                        loss += outputWeights[index] * sum;
+                    }
+                }
+            }
+        }
+        return loss;
+    }
+
+    // the central difference of the loss in one of the values, nan when it crosses the kink of relu
+    long double difference( std::vector<long double>& values, size_t index ) const {
+        const long double value = values[index];
+        std::vector<bool> positiveAbove, positiveBelow;
+        values[index] = value + STEP;
+        const long double above = loss(nullptr, &positiveAbove);
+        values[index] = value - STEP;
+        const long double below = loss(nullptr, &positiveBelow);
+        values[index] = value;
+        if (shape.activation == Activation::ReLU and positiveAbove != positiveBelow) return NAN;
+        return (above - below) / (2 * STEP);
+    }
+};
+
+static std::vector<long double> randomValues( size_t count ) {
+    std::uniform_real_distribution<double> distribution(-1, 1);
+    std::vector<long double> values(count);
+    for (long double& value : values) value = static_cast<dtype>(distribution(generator));
+    return values;
+}
+
+static double relativeError( long double actual, long double expected ) {
+    return static_cast<double>(std::fabs(actual - expected) / (1 + std::fabs(expected)));
+}
+
+// the largest error of grads against the differences of the direct convolution in values
+static double gradsError( const dtype* grads, const DirectConvolution& direct, std::vector<long double>& values ) {
+    double error = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        const long double expected = direct.difference(values, i);
+        if (!std::isnan(expected)) error = std::max(error, relativeError(grads[i], expected));
+    }
+    return error;
+}
+
+static bool check( const Case& c, size_t workspaceMemoryLimit ) {
+    Conv2d::workspaceMemoryLimit = workspaceMemoryLimit;
+    std::unique_ptr<Conv2d> layer = c.upsampling == 1
+        ? std::make_unique<Conv2d>(c.inChannels, c.outChannels, c.kernelSize, c.stride, c.padding, c.activation)
+        : std::make_unique<UpsampleConv2d>(c.upsampling, c.inChannels, c.outChannels, c.kernelSize, c.stride, c.padding, c.activation);
+
+    DirectConvolution direct { c, randomValues(c.pictures * c.inChannels * c.height * c.width), {}, randomValues(c.outChannels), {} };
+    direct.kernels.assign(layer->kernels.data.get(), layer->kernels.data.get() + layer->kernels.length);
+    direct.outputWeights = randomValues(c.pictures * c.outChannels * direct.outputHeight() * direct.outputWidth());
+    std::copy(direct.biases.begin(), direct.biases.end(), layer->biases.data.get());
+
+    Tensor input = Tensor::zeros({ c.pictures, c.inChannels, c.height, c.width });
+    std::copy(direct.input.begin(), direct.input.end(), input.data.get());
+
+    layer->forward(input);
+    std::vector<long double> outputs;
+    direct.loss(&outputs);
+    double outputError = layer->outputTensor.length == outputs.size() ? 0 : INFINITY;
+    for (size_t i = 0; i < std::min<size_t>(outputs.size(), layer->outputTensor.length); i++) {
+        outputError = std::max(outputError, relativeError(layer->outputTensor.data[i], outputs[i]));
+    }
+
+    std::copy(direct.outputWeights.begin(), direct.outputWeights.end(), layer->outputTensor.grads.get());
+    layer->backward();
+    const double inputError = gradsError(input.grads.get(), direct, direct.input);
+    const double kernelsError = gradsError(layer->kernels.grads.get(), direct, direct.kernels);
+    const double biasesError = gradsError(layer->biases.grads.get(), direct, direct.biases);
+
+    const bool passed = std::max({ outputError, inputError, kernelsError, biasesError }) <= TOLERANCE;
+    std::printf("  %-44s workspace %8zu B: output %.1e, grads of input %.1e, kernels %.1e, biases %.1e%s\n", c.name,
+                workspaceMemoryLimit, outputError, inputError, kernelsError, biasesError, passed ? "" : "  FAILED");
+    return passed;
+}
+
+
+int main() {
+    const Case cases[] = {
+        { "winograd, padding 0",                      1, 3, 3, 7, 7, 4, 3, 1, 0, Activation::None },
+        { "winograd, padding 1, odd sizes",           1, 3, 3, 5, 9, 4, 3, 1, 1, Activation::ReLU },
+        { "winograd, padding 2",                      1, 2, 2, 6, 5, 3, 3, 1, 2, Activation::Sigmoid },
+        { "winograd, upsampled",                      2, 3, 3, 4, 5, 4, 3, 1, 1, Activation::ReLU },
+        { "im2col, stride 2",                         1, 3, 3, 7, 8, 4, 3, 2, 1, Activation::ReLU },
+        { "im2col, 5x5 kernel",                       1, 2, 3, 7, 6, 2, 5, 1, 2, Activation::Sigmoid },
+        { "im2col, 2x2 kernel, stride 2, padding 0",  1, 3, 2, 6, 7, 3, 2, 2, 0, Activation::None },
+        { "im2col, 1x1 kernel",                       1, 2, 4, 5, 5, 3, 1, 1, 0, Activation::None },
+        { "im2col, upsampled, stride 2",              2, 2, 3, 4, 3, 4, 3, 2, 1, Activation::Sigmoid },
+        { "im2col, upsampled by 3, 4x4 kernel",       3, 2, 2, 3, 3, 3, 4, 1, 1, Activation::ReLU },
+    };
+
+    std::printf("convolutions against a direct one, %s, tolerance %.0e\n", sizeof(dtype) == sizeof(float) ? "float" : "double", TOLERANCE);
+    const size_t defaultLimit = Conv2d::workspaceMemoryLimit;
+    bool passed = true;
+    for (const Case& c : cases) {
+        passed &= check(c, defaultLimit);
+        passed &= check(c, 1); // chunks of a single row or picture
+    }
+    Conv2d::workspaceMemoryLimit = defaultLimit;
+
+    std::printf(passed ? "all passed\n" : "some failed\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+// checks that Model::planMemory and Model::checkpoint change nothing but memory: the same model is trained with
+// memory of its own for every output and with a plan, with and without checkpointed segments, and the losses, the
+// grads of the parameters and of the input and the parameters after every step have to be exactly the same. the
+// steps go on and off the planned batch size, with passes in inference mode in between, and adam works on packed
+// parameters. the model has every kind of layer, so a layer that says backward doesn't read something it does read
+// shows up here.
+//
+//   memoryPlanCheck
+//
+// exits with 1 if anything differs, which is how ctest runs it
+
+#include <cmath>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "mygrad/mygrad.hpp"
+
+using namespace mygrad;
+
+static constexpr size_t PLANNED_BATCH = 6, CLASSES = 5;
+
+static Model makeModel() {
+    return Model(
+        Conv2d(3, 8, 3, 2, 1, Activation::ReLU),              // 0, im2col
+        Conv2d(8, 8, 3, 1, 1),                                // 1, winograd
+        ReLU(),                                               // 2
+        MaxPool2d(2),                                         // 3
+        UpsampleConv2d(2, 8, 4, 3, 1, 1, Activation::Sigmoid), // 4
+        Sigmoid(),                                            // 5
+        Upsample(2),                                          // 6
+        Conv2d(4, 4, 3, 2, 1),                                // 7
+        Reshape({1, 4*8*8}, 0),                               // 8
+        LinearLayer(4*8*8, 20, Activation::ReLU),             // 9
+        LinearLayer(20, 2 * CLASSES),                         // 10
+        Reparameterize(1)                                     // 11
+    );
+}
+
+static Tensor batch( size_t pictures, size_t step ) {
+    Tensor images = Tensor::zeros({ pictures, 3, 16, 16 });
+    for (size_t i = 0; i < images.length; i++) images.data[i] = static_cast<dtype>(std::sin(0.37 * i + step));
+    return images;
+}
+
+static Tensor labels( size_t pictures, size_t step ) {
+    Tensor classes = Tensor::zeros({ pictures });
+    for (size_t i = 0; i < pictures; i++) classes.data[i] = static_cast<dtype>((i + step) % CLASSES);
+    return classes;
+}
+
+static bool same( const dtype* a, const dtype* b, size_t length ) {
+    for (size_t i = 0; i < length; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+struct Training {
+    Model model;
+    Adam optim;
+    CrossEntropyLoss loss;
+
+    explicit Training( Model&& m ) : model(std::move(m)), optim((model.packParameters(), model.parameters)) {}
+
+    dtype step( Tensor& images, const Tensor& classes ) {
+        images.zeroGrad();
+        const dtype value = loss(model(images), classes);
+        loss.backward();
+        model.backward();
+        return value;
+    }
+
+    void update() {
+        optim.step();
+        model.zeroGrad();
+    }
+};
+
+// the steps' batch sizes: planned, then off the plan, then planned again
+static const size_t BATCHES[] = { PLANNED_BATCH, PLANNED_BATCH, 4, PLANNED_BATCH, PLANNED_BATCH };
+
+static bool check( const std::vector<std::pair<size_t, size_t>>& segments ) {
+    setSeed(1);
+    Training plain(makeModel());
+    setSeed(1);
+    Training planned(makeModel());
+    for (const auto& [first, last] : segments) planned.model.checkpoint(first, last);
+    const MemoryPlan& plan = planned.model.planMemory({ PLANNED_BATCH, 3, 16, 16 });
+
+    std::printf("  segments");
+    for (const auto& [first, last] : segments) std::printf(" [%zu, %zu]", first, last);
+    if (segments.empty()) std::printf(" none");
+    std::printf(", arena %zu of %zu bytes: ", plan.plannedBytes, plan.naiveBytes);
+
+    for (size_t step = 0; step < std::size(BATCHES); step++) {
+        const size_t pictures = BATCHES[step];
+        Tensor plainImages = batch(pictures, step), plannedImages = batch(pictures, step);
+        const Tensor classes = labels(pictures, step);
+
+        const dtype plainLoss = plain.step(plainImages, classes), plannedLoss = planned.step(plannedImages, classes);
+        bool identical = plainLoss == plannedLoss and same(plainImages.grads.get(), plannedImages.grads.get(), plainImages.length);
+        for (size_t i = 0; i < plain.model.parameters.size(); i++) {
+            const Tensor& a = *plain.model.parameters[i];
+            const Tensor& b = *planned.model.parameters[i];
+            identical = identical and same(a.grads.get(), b.grads.get(), a.length);
+        }
+        plain.update(), planned.update();
+        for (size_t i = 0; i < plain.model.parameters.size(); i++) {
+            const Tensor& a = *plain.model.parameters[i];
+            const Tensor& b = *planned.model.parameters[i];
+            identical = identical and same(a.data.get(), b.data.get(), a.length);
+        }
+        if (!identical) {
+            std::printf("differs after step %zu (batch of %zu)  FAILED\n", step, pictures);
+            return false;
+        }
+
+        // in inference mode, on and off the planned batch size, which the next step has to recover from
+        InferenceMode inference;
+        for (size_t pictures : { PLANNED_BATCH, size_t(9) }) {
+            Tensor images = batch(pictures, step);
+            plain.model(images), planned.model(images);
+        }
+    }
+
+    std::printf("identical over %zu steps\n", std::size(BATCHES));
+    return true;
+}
+
+
+int main() {
+    const std::vector<std::vector<std::pair<size_t, size_t>>> cases = {
+        { },
+        { { 0, 3 }, { 4, 8 } },
+        { { 1, 10 } },
+        { { 0, 2 }, { 3, 6 }, { 7, 11 } },
+        { { 2, 5 }, { 9, 11 } },
+    };
+
+    std::printf("training with Model::planMemory and Model::checkpoint against without, %s\n",
+                sizeof(dtype) == sizeof(float) ? "float" : "double");
+    bool passed = true;
+    for (const auto& segments : cases) passed &= check(segments);
+
+    std::printf(passed ? "all passed\n" : "some failed\n");
+    return passed ? 0 : 1;
+}
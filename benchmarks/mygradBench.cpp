@@ -0,0 +1,310 @@
+// forward and backward of every layer, loss and optimizer on its own, over the shapes of the mnist and cats examples
+// and a few around them (batch one inference, a stride one convolution that takes the winograd path).
+//
+//   mygrad_bench [--filter text] [--min-time seconds] [--save results.csv] [--compare baseline.csv] [--tolerance fraction]
+//
+// every case runs until it has taken --min-time seconds (and at least three times), the median run is reported.
+// --save writes the results as csv, --compare reads such a file back and exits with 1 if any case got slower than
+// its baseline by more than --tolerance (0.1 by default), so a run against a saved baseline catches regressions
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include "mygrad/mygrad.hpp"
+
+using namespace mygrad;
+
+struct Case {
+    std::string name, shape;
+    std::function<void()> forward;   // the optimizer's step goes here
+    std::function<void()> backward;  // run after an untimed forward, empty for the optimizer
+    std::function<PassCost()> forwardCost, backwardCost;
+};
+
+struct Result {
+    std::string name, shape, pass;
+    double nanoseconds, gflops, gbs;
+};
+
+static std::mt19937 generator(0);
+
+static Tensor randomTensor( const TensorDims& dimensions, dtype low = -1, dtype high = 1 ) {
+    std::uniform_real_distribution<dtype> distribution(low, high);
+    Tensor tensor = Tensor::zeros(dimensions);
+    for (size_t i = 0; i < tensor.length; i++) tensor.data[i] = distribution(generator);
+    return tensor;
+}
+
+static std::string shapeOf( const TensorDims& dimensions ) {
+    std::string shape;
+    for (size_t i = 0; i < dimensions.size(); i++) {
+        if (i) shape += 'x';
+        shape += std::to_string(dimensions[i]);
+    }
+    return shape;
+}
+
+
+template <typename LayerType>
+static Case layerCase( std::string name, LayerType&& layer, const TensorDims& inputDimensions ) {
+    auto owned = std::make_shared<LayerType>(std::move(layer));
+    auto input = std::make_shared<Tensor>(randomTensor(inputDimensions));
+
+    return Case {
+        .name = std::move(name), .shape = shapeOf(inputDimensions),
+        .forward = [owned, input] { owned->forward(*input); },
+        .backward = [owned] { owned->backward(); },
+        .forwardCost = [owned] { return owned->forwardCost(); },
+        .backwardCost = [owned] { return owned->backwardCost(); }
+    };
+}
+
+static Case crossEntropyCase( size_t batchSize, size_t classes ) {
+    auto loss = std::make_shared<CrossEntropyLoss>();
+    auto logits = std::make_shared<Tensor>(randomTensor({ batchSize, classes }));
+    auto labels = std::make_shared<Tensor>(Tensor::zeros({ batchSize }));
+    for (size_t i = 0; i < batchSize; i++) labels->data[i] = i % classes;
+
+    return Case {
+        .name = "CrossEntropyLoss", .shape = shapeOf(logits->dimensions),
+        .forward = [loss, logits, labels] { (*loss)(*logits, *labels); },
+        .backward = [loss] { loss->backward(); },
+        .forwardCost = [logits] { return elementwiseCost(logits->length, 8, 2); },
+        .backwardCost = [logits] { return elementwiseCost(logits->length, 2, 3); }
+    };
+}
+
+static Case mseCase( const TensorDims& dimensions ) {
+    auto loss = std::make_shared<MSEloss>("sum");
+    auto outputs = std::make_shared<Tensor>(randomTensor(dimensions, 0, 1));
+    auto labels = std::make_shared<Tensor>(randomTensor(dimensions, 0, 1));
+
+    return Case {
+        .name = "MSEloss", .shape = shapeOf(dimensions),
+        .forward = [loss, outputs, labels] { (*loss)(*outputs, *labels); },
+        .backward = [loss] { loss->backward(); },
+        .forwardCost = [outputs] { return elementwiseCost(outputs->length, 3, 2); },
+        .backwardCost = [outputs] { return elementwiseCost(outputs->length, 4, 3); }
+    };
+}
+
+static Case klDivCase( size_t batchSize, size_t latent ) {
+    auto loss = std::make_shared<KLdivWithStandardNormal>();
+    auto distribution = std::make_shared<Tensor>(randomTensor({ batchSize, 2 * latent }));
+
+    return Case {
+        .name = "KLdivWithStandardNormal", .shape = shapeOf(distribution->dimensions),
+        .forward = [loss, distribution] { (*loss)(*distribution, 1); },
+        .backward = [loss] { loss->backward(); },
+        .forwardCost = [distribution] { return elementwiseCost(distribution->length, 3, 1); },
+        .backwardCost = [distribution] { return elementwiseCost(distribution->length, 3, 2); }
+    };
+}
+
+// the parameters of a model, with some grads to step with
+static Case adamCase( const std::string& modelName, std::shared_ptr<Model> model ) {
+    size_t parameters = 0;
+    for (Tensor* parameter : model->parameters) {
+        parameters += parameter->length;
+        for (size_t i = 0; i < parameter->length; i++) parameter->grads[i] = 1e-3 * ((i % 7) - 3.0);
+    }
+    auto optimizer = std::make_shared<Adam>(model->parameters);
+
+    return Case {
+        .name = "Adam::step", .shape = modelName + " " + std::to_string(parameters),
+        .forward = [model, optimizer] { optimizer->step(); },
+        .backward = {},
+        .forwardCost = [parameters] { return PassCost { 12.0 * parameters, 7.0 * parameters * sizeof(dtype) }; },
+        .backwardCost = {}
+    };
+}
+
+
+static std::vector<Case> allCases() {
+    const size_t mnistBatch = 64, mnistTestBatch = 1024;
+    const size_t catsBatch = 64, latent = 128;
+    std::vector<Case> cases;
+
+    // mnist: 784 -> 100 -> 100 -> 10
+    cases.push_back(layerCase("LinearLayer 784-100", LinearLayer(784, 100, Activation::ReLU), { mnistBatch, 784 }));
+    cases.push_back(layerCase("LinearLayer 784-100", LinearLayer(784, 100, Activation::ReLU), { mnistTestBatch, 784 }));
+    cases.push_back(layerCase("LinearLayer 100-100", LinearLayer(100, 100, Activation::ReLU), { mnistBatch, 100 }));
+    cases.push_back(layerCase("LinearLayer 100-10", LinearLayer(100, 10), { mnistBatch, 100 }));
+    cases.push_back(crossEntropyCase(mnistBatch, 10));
+    cases.push_back(crossEntropyCase(mnistTestBatch, 10));
+
+    // the cats encoder
+    cases.push_back(layerCase("Conv2d 3-32 k3 s2", Conv2d(3, 32, 3, 2, 1, Activation::ReLU), { catsBatch, 3, 64, 64 }));
+    cases.push_back(layerCase("Conv2d 3-32 k3 s2", Conv2d(3, 32, 3, 2, 1, Activation::ReLU), { 1, 3, 64, 64 }));
+    cases.push_back(layerCase("Conv2d 32-64 k3 s2", Conv2d(32, 64, 3, 2, 1, Activation::ReLU), { catsBatch, 32, 32, 32 }));
+    cases.push_back(layerCase("Conv2d 64-128 k3 s2", Conv2d(64, 128, 3, 2, 1, Activation::ReLU), { catsBatch, 64, 16, 16 }));
+    cases.push_back(layerCase("Conv2d 128-256 k3 s2", Conv2d(128, 256, 3, 2, 1, Activation::ReLU), { catsBatch, 128, 8, 8 }));
+    cases.push_back(layerCase("Reshape", Reshape({ 1, 256*4*4 }, 0), { catsBatch, 256, 4, 4 }));
+    cases.push_back(layerCase("LinearLayer 4096-256", LinearLayer(256*4*4, 2 * latent), { catsBatch, 256*4*4 }));
+    cases.push_back(layerCase("LinearLayer 4096-256", LinearLayer(256*4*4, 2 * latent), { 1, 256*4*4 }));
+    cases.push_back(layerCase("Reparameterize", Reparameterize(), { catsBatch, 2 * latent }));
+    cases.push_back(klDivCase(catsBatch, latent));
+
+    // the cats decoder
+    cases.push_back(layerCase("LinearLayer 128-4096", LinearLayer(latent, 256*4*4), { catsBatch, latent }));
+    cases.push_back(layerCase("UpsampleConv2d 256-128", UpsampleConv2d(2, 256, 128, 3, 1, 1, Activation::ReLU), { catsBatch, 256, 4, 4 }));
+    cases.push_back(layerCase("UpsampleConv2d 128-64", UpsampleConv2d(2, 128, 64, 3, 1, 1, Activation::ReLU), { catsBatch, 128, 8, 8 }));
+    cases.push_back(layerCase("UpsampleConv2d 64-32", UpsampleConv2d(2, 64, 32, 3, 1, 1, Activation::ReLU), { catsBatch, 64, 16, 16 }));
+    cases.push_back(layerCase("UpsampleConv2d 32-3", UpsampleConv2d(2, 32, 3, 3, 1, 1, Activation::Sigmoid), { catsBatch, 32, 32, 32 }));
+    cases.push_back(layerCase("UpsampleConv2d 32-3", UpsampleConv2d(2, 32, 3, 3, 1, 1, Activation::Sigmoid), { 1, 32, 32, 32 }));
+    cases.push_back(mseCase({ catsBatch, 3, 64, 64 }));
+
+    // the layers the examples no longer use, at the sizes they had there
+    cases.push_back(layerCase("Conv2d 64-64 k3 s1", Conv2d(64, 64, 3, 1, 1), { 16, 64, 32, 32 }));
+    cases.push_back(layerCase("Upsample 2", Upsample(2), { catsBatch, 256, 4, 4 }));
+    cases.push_back(layerCase("Upsample 2", Upsample(2), { catsBatch, 32, 32, 32 }));
+    cases.push_back(layerCase("MaxPool2d 2", MaxPool2d(2), { catsBatch, 32, 32, 32 }));
+    cases.push_back(layerCase("ReLU", ReLU(), { mnistBatch, 100 }));
+    cases.push_back(layerCase("ReLU", ReLU(), { catsBatch, 32, 32, 32 }));
+    cases.push_back(layerCase("Sigmoid", Sigmoid(), { catsBatch, 3, 64, 64 }));
+
+    // the optimizer over the parameters of both examples
+    cases.push_back(adamCase("mnist", std::make_shared<Model>(
+        LinearLayer(784, 100), LinearLayer(100, 100), LinearLayer(100, 10))));
+    cases.push_back(adamCase("cats", std::make_shared<Model>(
+        Conv2d(3, 32, 3, 2, 1), Conv2d(32, 64, 3, 2, 1), Conv2d(64, 128, 3, 2, 1), Conv2d(128, 256, 3, 2, 1),
+        LinearLayer(256*4*4, 2 * latent), LinearLayer(latent, 256*4*4),
+        UpsampleConv2d(2, 256, 128, 3, 1, 1), UpsampleConv2d(2, 128, 64, 3, 1, 1),
+        UpsampleConv2d(2, 64, 32, 3, 1, 1), UpsampleConv2d(2, 32, 3, 3, 1, 1))));
+
+    return cases;
+}
+
+
+// the median of runs of run(), each after an untimed prepare()
+static double medianNanoseconds( const std::function<void()>& prepare, const std::function<void()>& run, double minSeconds ) {
+    using Clock = std::chrono::steady_clock;
+    if (prepare) prepare();
+    run(); // warm up: buffers get their sizes, the pool starts
+
+    std::vector<double> runs;
+    double total = 0;
+    while (total < minSeconds * 1e9 or runs.size() < 3) {
+        if (prepare) prepare();
+        const auto start = Clock::now();
+        run();
+        const double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        runs.push_back(nanoseconds);
+        total += nanoseconds;
+    }
+    std::nth_element(runs.begin(), runs.begin() + runs.size() / 2, runs.end());
+    return runs[runs.size() / 2];
+}
+
+static Result measure( const Case& benchmark, const std::string& pass, double minSeconds ) {
+    const bool forward = pass != "backward";
+    const double nanoseconds = forward ? medianNanoseconds({}, benchmark.forward, minSeconds)
+                                       : medianNanoseconds(benchmark.forward, benchmark.backward, minSeconds);
+
+    // backward lets go of its input, so its cost is read after a forward
+    if (!forward) benchmark.forward();
+    const PassCost cost = forward ? benchmark.forwardCost() : benchmark.backwardCost();
+    if (!forward) benchmark.backward();
+
+    return { benchmark.name, benchmark.shape, pass, nanoseconds, cost.flops / nanoseconds, cost.bytes / nanoseconds };
+}
+
+
+static std::string keyOf( const Result& result ) { return result.name + "|" + result.shape + "|" + result.pass; }
+
+static void save( const std::vector<Result>& results, const std::string& filename ) {
+    std::ofstream file(filename);
+    if (!file.is_open()) throw std::runtime_error("failed to open file " + filename);
+    file << "name,shape,pass,nanoseconds,gflops,gbs\n";
+    for (const Result& result : results) {
+        file << result.name << "," << result.shape << "," << result.pass << ","
+             << result.nanoseconds << "," << result.gflops << "," << result.gbs << "\n";
+    }
+}
+
+static std::map<std::string, double> loadBaseline( const std::string& filename ) {
+    std::ifstream file(filename);
+    if (!file.is_open()) throw std::runtime_error("failed to open file " + filename);
+
+    std::map<std::string, double> baseline;
+    std::string line;
+    std::getline(file, line); // the header
+    while (std::getline(file, line)) {
+        std::stringstream fields(line);
+        Result result;
+        std::string nanoseconds;
+        std::getline(fields, result.name, ',');
+        std::getline(fields, result.shape, ',');
+        std::getline(fields, result.pass, ',');
+        std::getline(fields, nanoseconds, ',');
+        if (!nanoseconds.empty()) baseline[keyOf(result)] = std::stod(nanoseconds);
+    }
+    return baseline;
+}
+
+
+int main( int argc, char** argv ) {
+    std::string filter, saveTo, compareWith;
+    double minSeconds = 0.2, tolerance = 0.1;
+
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--filter") and hasValue) filter = argv[++i];
+        else if (!std::strcmp(argv[i], "--min-time") and hasValue) minSeconds = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--save") and hasValue) saveTo = argv[++i];
+        else if (!std::strcmp(argv[i], "--compare") and hasValue) compareWith = argv[++i];
+        else if (!std::strcmp(argv[i], "--tolerance") and hasValue) tolerance = std::atof(argv[++i]);
+        else {
+            std::fprintf(stderr, "usage: %s [--filter text] [--min-time seconds] [--save results.csv] "
+                                 "[--compare baseline.csv] [--tolerance fraction]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const std::map<std::string, double> baseline = compareWith.empty() ? std::map<std::string, double>() : loadBaseline(compareWith);
+
+    std::printf("%zu threads, %s\n\n", ThreadPool::size(), sizeof(dtype) == sizeof(float) ? "float" : "double");
+    std::printf("%-28s %-14s %-9s %12s %9s %8s%s\n", "case", "shape", "pass", "us", "GFLOP/s", "GB/s",
+                baseline.empty() ? "" : "  vs baseline");
+
+    std::vector<Result> results;
+    size_t regressions = 0;
+    for (const Case& benchmark : allCases()) {
+        if (!filter.empty() and (benchmark.name + " " + benchmark.shape).find(filter) == std::string::npos) continue;
+
+        for (std::string pass : { "forward", "backward" }) {
+            if (pass == "backward" and !benchmark.backward) continue;
+            if (!benchmark.backward) pass = "step";
+            const Result result = measure(benchmark, pass, minSeconds);
+            results.push_back(result);
+
+            std::printf("%-28s %-14s %-9s %12.1f %9.2f %8.2f", result.name.c_str(), result.shape.c_str(), result.pass.c_str(),
+                        result.nanoseconds * 1e-3, result.gflops, result.gbs);
+            if (auto found = baseline.find(keyOf(result)); found != baseline.end()) {
+                const double change = result.nanoseconds / found->second - 1;
+                const bool regressed = change > tolerance;
+                regressions += regressed;
+                std::printf("  %+6.1f%%%s", 100 * change, regressed ? "  slower" : "");
+            }
+            std::printf("\n");
+        }
+    }
+
+    if (!saveTo.empty()) save(results, saveTo);
+    if (!baseline.empty()) {
+        std::printf("\n%zu of %zu cases slower than the baseline by more than %.0f%%\n", regressions, results.size(), 100 * tolerance);
+    }
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+// latency of getting empty jobs through the thread pool: push, then waitUntilDone.
+// a single job is the pure overhead of a round trip, one job per thread is what every layer does per call,
+// through parallelFor.
+// every row is run again on the pool mygrad had before the work-stealing one, a single queue behind a mutex with a
+// condition variable, kept here with the same number of threads so the two can be compared on any machine
+//
+//   threadPoolBenchmark [rounds]
+
+#include <queue>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <condition_variable>
+
+#include "mygrad/threadPool.hpp"
+
+using namespace mygrad;
+
+// the baseline: one std::function queue shared by every thread, and a wait that sleeps until the count is 0
+class QueuePool {
+public:
+    explicit QueuePool( size_t size ) {
+        for (size_t i = 0; i < size; i++) threads.emplace_back([this] { threadLoop(); });
+    }
+
+    ~QueuePool() {
+        {
+            std::lock_guard lock(jobsMutex);
+            terminate = true;
+        }
+        jobsAvailable.notify_all();
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    void push( std::function<void()> job ) {
+        std::lock_guard lock(jobsMutex);
+        jobs.push(std::move(job));
+        jobsRemaining++;
+        jobsAvailable.notify_one();
+    }
+
+    void waitUntilDone() {
+        std::unique_lock lock(doneMutex);
+        allDone.wait(lock, [this] { return jobsRemaining == 0; });
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::queue<std::function<void()>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsAvailable;
+
+    std::mutex doneMutex;
+    std::condition_variable allDone;
+    std::atomic<size_t> jobsRemaining {0};
+    bool terminate = false;
+
+    void threadLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(jobsMutex);
+                jobsAvailable.wait(lock, [this] { return !jobs.empty() or terminate; });
+                if (jobs.empty() and terminate) return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+
+            if (--jobsRemaining == 0) {
+                std::lock_guard lock(doneMutex);
+                allDone.notify_all();
+            }
+        }
+    }
+};
+
+// ThreadPool's static functions behind the same interface as a QueuePool
+struct WorkStealingPool {
+    template <typename Function>
+    void push( Function&& job ) { ThreadPool::push(std::forward<Function>(job)); }
+    void waitUntilDone() { ThreadPool::waitUntilDone(); }
+};
+
+template <typename Pool>
+static double nanosecondsPerRound( Pool& pool, size_t jobsPerRound, size_t rounds ) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        for (size_t job = 0; job < jobsPerRound; job++) {
+            pool.push([] {});
+        }
+        pool.waitUntilDone();
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / rounds;
+}
+
+static double nanosecondsPerParallelFor( size_t chunks, size_t rounds ) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        parallelFor(0, chunks, 1, [] (size_t, size_t) {});
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / rounds;
+}
+
+int main( int argc, char** argv ) {
+    const size_t rounds = argc > 1 ? std::atoi(argv[1]) : 20000;
+    const size_t threads = ThreadPool::size();
+    const size_t jobCounts[] = { 1, threads, 8 * threads }, roundsFor[] = { rounds, rounds, rounds / 8 };
+
+    // the work-stealing pool first, its workers are asleep by the time the baseline's start
+    WorkStealingPool workStealing;
+    nanosecondsPerRound(workStealing, threads, rounds / 10); // warm up, the pool starts its threads on first use
+    double workStealingTimes[std::size(jobCounts)];
+    for (size_t i = 0; i < std::size(jobCounts); i++) {
+        workStealingTimes[i] = nanosecondsPerRound(workStealing, jobCounts[i], roundsFor[i]);
+    }
+    const double parallelForTime = nanosecondsPerParallelFor(threads, rounds);
+
+    double queueTimes[std::size(jobCounts)];
+    {
+        QueuePool queue(threads);
+        nanosecondsPerRound(queue, threads, rounds / 10);
+        for (size_t i = 0; i < std::size(jobCounts); i++) {
+            queueTimes[i] = nanosecondsPerRound(queue, jobCounts[i], roundsFor[i]);
+        }
+    }
+
+    std::printf("thread pool with %zu threads, %zu rounds, ns per push + waitUntilDone\n", threads, rounds);
+    std::printf("                 %14s %14s\n", "work-stealing", "single queue");
+    for (size_t i = 0; i < std::size(jobCounts); i++) {
+        std::printf("%4zu empty job%s %14.0f %14.0f\n", jobCounts[i], jobCounts[i] == 1 ? ": " : "s:",
+                    workStealingTimes[i], queueTimes[i]);
+    }
+    std::printf("%4zu empty chunks:%13.0f ns per parallelFor\n", threads, parallelForTime);
+}
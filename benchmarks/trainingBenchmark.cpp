@@ -0,0 +1,236 @@
+// training throughput of the two examples, on synthetic data so no dataset is needed: the exact architectures of
+// examples/mnist/main.cpp and examples/cats/main.cpp, and the same steps their training loops take.
+//
+//   trainingBenchmark <mnist|cats> [--steps n] [--warmup n] [--batch size] [--checkpoint] [--min-throughput samples/s] [--max-p99-ms ms]
+//
+// reports the p50 and p99 step time, samples per second, the peak resident memory, the hits and misses of the
+// MemoryCache over the timed steps (misses are allocations from the system) and, for every model, the memory of
+// the layers' outputs with Model::planMemory against what they'd take with memory of their own each. --checkpoint
+// marks segments of the models with Model::checkpoint first and reports what each saves and what running it again
+// costs. exits with 1 if the throughput is under --min-throughput or the p99 step time over --max-p99-ms, which is
+// how ctest runs it
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "mygrad/mygrad.hpp"
+
+using namespace mygrad;
+
+static std::mt19937 generator(0);
+
+static bool checkpointSegments = false;
+
+struct PlannedModel {
+    std::string name;
+    const Model* model; // kept alive by its workload
+};
+static std::vector<PlannedModel> plannedModels;
+
+static const MemoryPlan& planMemory( const std::string& name, Model& model, const TensorDims& inputDimensions ) {
+    plannedModels.push_back({ name, &model });
+    return model.planMemory(inputDimensions);
+}
+
+// a few batches, cycled through, so the random numbers aren't part of the step time
+static std::vector<Tensor> syntheticBatches( const TensorDims& dimensions, dtype low, dtype high, size_t count = 4 ) {
+    std::uniform_real_distribution<dtype> distribution(low, high);
+    std::vector<Tensor> batches;
+    for (size_t i = 0; i < count; i++) {
+        batches.push_back(Tensor::zeros(dimensions));
+        for (size_t j = 0; j < batches.back().length; j++) batches.back().data[j] = distribution(generator);
+    }
+    return batches;
+}
+
+static double peakResidentMegabytes() {
+#if defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / double(1 << 20); // bytes
+#elif defined(__unix__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / double(1 << 10); // kilobytes
+#else
+    return 0;
+#endif
+}
+
+
+// examples/mnist: the mlp, cross entropy and adam, as in its train()
+static std::function<void(size_t)> mnistStep( size_t batchSize ) {
+    const size_t pixelsInImage = 784, numberOfClasses = 10, neurons = 100;
+
+    struct Workload {
+        Model model {
+            LinearLayer( pixelsInImage, neurons, Activation::ReLU ),
+            LinearLayer( neurons, neurons, Activation::ReLU ),
+            LinearLayer( neurons, numberOfClasses )
+        };
+        CrossEntropyLoss loss;
+        Adam optim { model.parameters, 0.001 };
+        std::vector<Tensor> inputs, labels;
+    };
+    auto workload = std::make_shared<Workload>();
+    workload->model.packParameters();
+    if (checkpointSegments) workload->model.checkpoint(0, 2);
+    planMemory("mlp", workload->model, { batchSize, pixelsInImage });
+    workload->inputs = syntheticBatches({ batchSize, pixelsInImage }, -1, 1);
+    workload->labels = syntheticBatches({ batchSize }, 0, 0);
+    for (Tensor& labels : workload->labels) {
+        for (size_t i = 0; i < labels.length; i++) labels.data[i] = generator() % numberOfClasses;
+    }
+
+    return [workload] (size_t step) {
+        Workload& w = *workload;
+        Tensor& output = w.model.forward(w.inputs[step % w.inputs.size()]);
+        w.loss(output, w.labels[step % w.labels.size()]);
+        w.loss.backward();
+        w.model.backward();
+        w.optim.step();
+        w.model.zeroGrad();
+    };
+}
+
+// examples/cats: the vae, mse plus kl divergence and adam, as in its trainForOneEpoch()
+static std::function<void(size_t)> catsStep( size_t batchSize ) {
+    const size_t latent = 128, imageSizeBeforeLatent = 256*4*4;
+
+    struct Workload {
+        Model encoder {
+            Conv2d(3, 32, 3, 2, 1, Activation::ReLU),
+            Conv2d(32, 64, 3, 2, 1, Activation::ReLU),
+            Conv2d(64, 128, 3, 2, 1, Activation::ReLU),
+            Conv2d(128, 256, 3, 2, 1, Activation::ReLU),
+            Reshape({1, imageSizeBeforeLatent}, 0),
+            LinearLayer(imageSizeBeforeLatent, latent * 2)
+        };
+        Model decoder {
+            LinearLayer(latent, imageSizeBeforeLatent),
+            Reshape({1, 256, 4, 4}, 0),
+            UpsampleConv2d(2, 256, 128, 3, 1, 1, Activation::ReLU),
+            UpsampleConv2d(2, 128, 64, 3, 1, 1, Activation::ReLU),
+            UpsampleConv2d(2, 64, 32, 3, 1, 1, Activation::ReLU),
+            UpsampleConv2d(2, 32, 3, 3, 1, 1, Activation::Sigmoid)
+        };
+        Reparameterize reparam;
+        KLdivWithStandardNormal kldiv;
+        MSEloss mse { "sum" };
+        std::unique_ptr<Adam> optim;
+        std::vector<Tensor> inputs;
+    };
+    auto workload = std::make_shared<Workload>();
+    workload->encoder.packParameters(), workload->decoder.packParameters();
+    if (checkpointSegments) workload->encoder.checkpoint(0, 3), workload->decoder.checkpoint(2, 5);
+    const MemoryPlan& encoderPlan = planMemory("encoder", workload->encoder, { batchSize, 3, 64, 64 });
+    planMemory("decoder", workload->decoder, workload->reparam.outputDimensions(encoderPlan.outputDimensions.back()));
+    std::vector<Tensor*> parameters = workload->encoder.parameters;
+    parameters.insert(parameters.end(), workload->decoder.parameters.begin(), workload->decoder.parameters.end());
+    workload->optim = std::make_unique<Adam>(parameters, 0.001);
+    workload->inputs = syntheticBatches({ batchSize, 3, 64, 64 }, 0, 1);
+
+    return [workload] (size_t step) {
+        Workload& w = *workload;
+        Tensor& batchInputs = w.inputs[step % w.inputs.size()];
+
+        Tensor& latentDistributions = w.encoder(batchInputs);
+        Tensor& encoding = w.reparam(latentDistributions);
+        Tensor& outputs = w.decoder(encoding);
+        w.mse(outputs, batchInputs), w.kldiv(latentDistributions, 1);
+
+        w.encoder.zeroGrad(), w.reparam.zeroGrad(), w.decoder.zeroGrad();
+        w.mse.backward(), w.kldiv.backward(), w.decoder.backward(), w.reparam.backward(), w.encoder.backward();
+        w.optim->step();
+    };
+}
+
+
+int main( int argc, char** argv ) {
+    if (argc < 2 or (std::strcmp(argv[1], "mnist") and std::strcmp(argv[1], "cats"))) {
+        std::fprintf(stderr, "usage: %s <mnist|cats> [--steps n] [--warmup n] [--batch size] [--checkpoint] "
+                             "[--min-throughput samples/s] [--max-p99-ms ms]\n", argv[0]);
+        return 2;
+    }
+    const std::string workload = argv[1];
+    size_t steps = 50, warmup = 3, batchSize = 64; // both examples train with batches of 64
+    double minThroughput = 0, maxP99Milliseconds = 0;
+
+    for (int i = 2; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--steps") and hasValue) steps = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--warmup") and hasValue) warmup = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--batch") and hasValue) batchSize = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--checkpoint")) checkpointSegments = true;
+        else if (!std::strcmp(argv[i], "--min-throughput") and hasValue) minThroughput = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--max-p99-ms") and hasValue) maxP99Milliseconds = std::atof(argv[++i]);
+        else {
+            std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    const std::function<void(size_t)> step = workload == "mnist" ? mnistStep(batchSize) : catsStep(batchSize);
+
+    for (size_t i = 0; i < warmup; i++) step(i);
+    MemoryCache::resetStats();
+
+    std::vector<double> milliseconds;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; i++) {
+        const auto stepStart = std::chrono::steady_clock::now();
+        step(warmup + i);
+        milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count());
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(milliseconds.begin(), milliseconds.end());
+    auto percentile = [&milliseconds] (double fraction) {
+        return milliseconds[std::min(milliseconds.size() - 1, static_cast<size_t>(fraction * milliseconds.size()))];
+    };
+    const double throughput = steps * batchSize / seconds, p99 = percentile(0.99);
+
+    std::printf("%s, batch %zu, %zu steps, %zu threads, %s\n", workload.c_str(), batchSize, steps, ThreadPool::size(),
+                sizeof(dtype) == sizeof(float) ? "float" : "double");
+    std::printf("  step p50 %10.2f ms\n", percentile(0.5));
+    std::printf("  step p99 %10.2f ms\n", p99);
+    std::printf("  throughput %8.1f samples/s\n", throughput);
+    std::printf("  peak rss %10.1f MB\n", peakResidentMegabytes());
+    const MemoryCache::Stats cacheStats = MemoryCache::stats();
+    std::printf("  tensor memory %zu cache hits, %zu misses, %.1f MB cached\n", cacheStats.hits, cacheStats.misses,
+                cacheStats.cachedBytes / double(1 << 20));
+    for (const auto& [name, model] : plannedModels) {
+        const MemoryPlan& plan = *model->memoryPlan();
+        std::printf("  %s activations %.1f MB planned, %.1f MB unplanned\n", name.c_str(), plan.plannedBytes / double(1 << 20),
+                    plan.naiveBytes / double(1 << 20));
+        for (const CheckpointedSegment& segment : model->checkpointedSegments()) {
+            std::printf("    layers %zu to %zu checkpointed: %.1f MB saved, %.0f%% of the forward flops again, %.2f ms a step\n",
+                        segment.firstLayer, segment.lastLayer, segment.savedBytes / double(1 << 20),
+                        segment.forwardFlops > 0 ? 100 * segment.recomputeFlops / segment.forwardFlops : 0.0,
+                        segment.recomputes ? 1000 * segment.recomputeSeconds / segment.recomputes : 0.0);
+        }
+    }
+
+    bool failed = false;
+    if (minThroughput > 0 and throughput < minThroughput) {
+        std::printf("throughput under the threshold of %.1f samples/s\n", minThroughput);
+        failed = true;
+    }
+    if (maxP99Milliseconds > 0 and p99 > maxP99Milliseconds) {
+        std::printf("p99 step time over the threshold of %.2f ms\n", maxP99Milliseconds);
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
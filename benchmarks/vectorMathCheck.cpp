@@ -0,0 +1,146 @@
+// checks exp, log and sigmoid of vectorMath, in double and in float, and vectorExp, vectorLog and vectorSigmoid
+// against std::exp and std::log in long double rounded to the type: an even sweep over the range where the results
+// are finite and not 0, a sweep over the bit patterns, which covers every exponent from the subnormals to the
+// largest floats, and the ends on their own: the last inputs before exp overflows or underflows and the first after,
+// 0, subnormals, inf and nan.
+//
+//   vectorMathCheck
+//
+// prints the largest error of every function in ulp and exits with 1 if any is over what vectorMath.hpp promises,
+// which is how ctest runs it
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <type_traits>
+
+#include "mygrad/vectorMath.hpp"
+
+using namespace mygrad;
+
+static constexpr size_t SWEEP = size_t(1) << 20;
+
+// how many floats lie between a and b, 0 when both are nan and the most there is when only one is. infinities
+// have to be exact, one float away from the largest finite one isn't close
+template <typename T>
+static uint64_t ulpDistance( T a, T b ) {
+    using Bits = typename vectorMath::Traits<T>::Bits;
+    using SignedBits = std::make_signed_t<Bits>;
+    if (a != a or b != b) return a != a and b != b ? 0 : UINT64_MAX;
+    if (std::isinf(a) or std::isinf(b)) return a == b ? 0 : UINT64_MAX;
+    // onto integers in the same order as the floats, with -0 and 0 both at 0
+    const auto ordered = [] (T value) -> int64_t {
+        const SignedBits bits = std::bit_cast<SignedBits>(value);
+        return bits < 0 ? -static_cast<int64_t>(bits & std::numeric_limits<SignedBits>::max()) : bits;
+    };
+    const int64_t difference = ordered(a) - ordered(b);
+    return static_cast<uint64_t>(difference < 0 ? -difference : difference);
+}
+
+template <typename T>
+static void addEvenSweep( std::vector<T>& inputs, long double from, long double to ) {
+    for (size_t i = 0; i <= SWEEP; i++) inputs.push_back(static_cast<T>(from + (to - from) * i / SWEEP));
+}
+
+// every SWEEPth bit pattern from 0 up to the largest float, of the sign given
+template <typename T>
+static void addBitSweep( std::vector<T>& inputs, bool negative ) {
+    using Bits = typename vectorMath::Traits<T>::Bits;
+    const Bits last = std::bit_cast<Bits>(std::numeric_limits<T>::max()), step = last / SWEEP;
+    for (Bits bits = 0; bits <= last - step; bits += step) inputs.push_back(negative ? -std::bit_cast<T>(bits) : std::bit_cast<T>(bits));
+}
+
+// x itself, the floats either side of it and its negative
+template <typename T>
+static void addAround( std::vector<T>& inputs, T x ) {
+    for (T value : { std::nextafter(x, -INFINITY), x, std::nextafter(x, INFINITY) }) {
+        inputs.push_back(value);
+        inputs.push_back(-value);
+    }
+}
+
+template <typename T>
+static std::vector<T> ends() {
+    using Tr = vectorMath::Traits<T>;
+    using limits = std::numeric_limits<T>;
+    std::vector<T> inputs = { limits::infinity(), -limits::infinity(), limits::quiet_NaN() };
+    for (T x : { T(0), T(1), limits::denorm_min(), limits::min(), limits::max(), Tr::EXP_MIN, Tr::EXP_MAX,
+                 std::log(limits::max()), std::log(limits::min()), std::log(limits::denorm_min()) }) {
+        addAround(inputs, x);
+    }
+    // where 2^n used to overflow with the result still finite
+    for (T x : { T(709.5), T(709.7), T(88.5), T(88.7) }) addAround(inputs, x);
+    return inputs;
+}
+
+template <typename T, typename Reference>
+static bool check( const char* name, const std::vector<T>& inputs, const std::vector<T>& outputs, Reference reference, uint64_t tolerance ) {
+    uint64_t largest = 0;
+    size_t worst = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const uint64_t distance = ulpDistance(outputs[i], static_cast<T>(reference(static_cast<long double>(inputs[i]))));
+        if (distance >= largest) largest = distance, worst = i;
+    }
+    const bool passed = largest <= tolerance;
+    if (largest == UINT64_MAX) {
+        std::printf("  %-16s %-6s over %8zu inputs: wrong at x = %a (%a, expected %a)  FAILED\n", name,
+                    sizeof(T) == sizeof(float) ? "float" : "double", inputs.size(), static_cast<double>(inputs[worst]),
+                    static_cast<double>(outputs[worst]), static_cast<double>(reference(static_cast<long double>(inputs[worst]))));
+    } else {
+        std::printf("  %-16s %-6s over %8zu inputs: %llu ulp at most, at x = %a%s\n", name,
+                    sizeof(T) == sizeof(float) ? "float" : "double", inputs.size(), static_cast<unsigned long long>(largest),
+                    static_cast<double>(inputs[worst]), passed ? "" : "  FAILED");
+    }
+    return passed;
+}
+
+template <typename T>
+static bool checkAll( uint64_t logTolerance, uint64_t sigmoidTolerance ) {
+    using Tr = vectorMath::Traits<T>;
+    const auto exp = [] (long double x) { return std::exp(x); };
+    const auto log = [] (long double x) { return std::log(x); };
+    const auto sigmoid = [] (long double x) { return 1 / (1 + std::exp(-x)); };
+
+    std::vector<T> expInputs = ends<T>(), logInputs = ends<T>(), sigmoidInputs = ends<T>();
+    addEvenSweep(expInputs, Tr::EXP_MIN, Tr::EXP_MAX);
+    addBitSweep(expInputs, false), addBitSweep(expInputs, true);
+    addEvenSweep(logInputs, 0.5L, 2.0L);
+    addBitSweep(logInputs, false);
+    addEvenSweep(sigmoidInputs, Tr::EXP_MIN, -Tr::EXP_MIN);
+    addBitSweep(sigmoidInputs, false), addBitSweep(sigmoidInputs, true);
+
+    const auto apply = [] (const std::vector<T>& inputs, T (*function)(T)) {
+        std::vector<T> outputs(inputs.size());
+        for (size_t i = 0; i < inputs.size(); i++) outputs[i] = function(inputs[i]);
+        return outputs;
+    };
+    bool passed = check("exp", expInputs, apply(expInputs, vectorMath::exp<T>), exp, 1);
+    passed &= check("log", logInputs, apply(logInputs, vectorMath::log<T>), log, logTolerance);
+    passed &= check("sigmoid", sigmoidInputs, apply(sigmoidInputs, vectorMath::sigmoid<T>), sigmoid, sigmoidTolerance);
+
+    // and the array versions in the library, which are vectorized and built with its flags
+    if constexpr (std::is_same_v<T, dtype>) {
+        const auto applyArray = [] (const std::vector<T>& inputs, void (*function)(const dtype*, dtype*, size_t)) {
+            std::vector<T> outputs(inputs.size());
+            function(inputs.data(), outputs.data(), inputs.size());
+            return outputs;
+        };
+        passed &= check("vectorExp", expInputs, applyArray(expInputs, vectorExp), exp, 1);
+        passed &= check("vectorLog", logInputs, applyArray(logInputs, vectorLog), log, logTolerance);
+        passed &= check("vectorSigmoid", sigmoidInputs, applyArray(sigmoidInputs, vectorSigmoid), sigmoid, sigmoidTolerance);
+    }
+    return passed;
+}
+
+
+int main() {
+    std::printf("vectorMath against std:: in long double\n");
+    bool passed = checkAll<double>(2, 2);
+    passed &= checkAll<float>(3, 2);
+
+    std::printf(passed ? "all passed\n" : "some failed\n");
+    return passed ? 0 : 1;
+}
@@ -31,14 +31,10 @@ int main(int argc, char* argv[]) {
     const size_t imageSizeBeforeLatent = 256*4*4;
 
     Model encoder {
-        Conv2d(3, 32, 3, 2, 1), // B x 32 x 32 x 32
-        ReLU(),
-        Conv2d(32, 64, 3, 2, 1), // B x 64 x 16 x 16
-        ReLU(),
-        Conv2d(64, 128, 3, 2, 1), // B x 128 x 8 x 8
-        ReLU(),
-        Conv2d(128, 256, 3, 2, 1), // B x 256 x 4 x 4
-        ReLU(),
+        Conv2d(3, 32, 3, 2, 1, Activation::ReLU), // B x 32 x 32 x 32
+        Conv2d(32, 64, 3, 2, 1, Activation::ReLU), // B x 64 x 16 x 16
+        Conv2d(64, 128, 3, 2, 1, Activation::ReLU), // B x 128 x 8 x 8
+        Conv2d(128, 256, 3, 2, 1, Activation::ReLU), // B x 256 x 4 x 4
         Reshape({1, imageSizeBeforeLatent}, 0),
         LinearLayer(imageSizeBeforeLatent, latent * 2)
     };
@@ -46,12 +42,12 @@ int main(int argc, char* argv[]) {
     Model decoder {
         LinearLayer(latent, imageSizeBeforeLatent),
         Reshape({1, 256, 4, 4}, 0),
-        Upsample(2), Conv2d(256, 128, 3, 1, 1), ReLU(),
-        Upsample(2), Conv2d(128, 64, 3, 1, 1), ReLU(),
-        Upsample(2), Conv2d(64, 32, 3, 1, 1), ReLU(),
-        Upsample(2), Conv2d(32, 3, 3, 1, 1),
-        Sigmoid()
+        UpsampleConv2d(2, 256, 128, 3, 1, 1, Activation::ReLU), // B x 128 x 8 x 8
+        UpsampleConv2d(2, 128, 64, 3, 1, 1, Activation::ReLU),  // B x 64 x 16 x 16
+        UpsampleConv2d(2, 64, 32, 3, 1, 1, Activation::ReLU),   // B x 32 x 32 x 32
+        UpsampleConv2d(2, 32, 3, 3, 1, 1, Activation::Sigmoid)  // B x 3 x 64 x 64
     };
+    encoder.packParameters(), decoder.packParameters();
 
 
     if (options.mode == "train") {
@@ -64,6 +60,7 @@ int main(int argc, char* argv[]) {
 
     } else if (options.mode == "reconstruct") {
 
+        InferenceMode inference;
         Dataset images = loadCatImages(0.9, 0.1);
 
         encoder.load("../pretrained_encoder.model");
@@ -73,6 +70,7 @@ int main(int argc, char* argv[]) {
 
     } else if (options.mode == "generate") {
 
+        InferenceMode inference;
         size_t amountOfImages = options.amountOfImages.value_or(DEFAULT_AMOUNT_OF_IMAGES);
 
         decoder.load("../pretrained_decoder.model");
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <filesystem>
+#include <cstdlib>
 
 #include "modelRunner.hpp"
 #include "processData.hpp"
@@ -40,9 +41,22 @@ void trainModel( Model& encoder, Model& decoder, Dataset& dataset ) {
     const size_t trainingPatience = 10, LRpatience=5;
     const size_t trainBatchSize = 64, evalBatchSize = 512;
 
+    // the outputs of the layers share memory where their lives allow, at the training batch size
+    TensorDims batchDimensions = dataset.train.dimensions;
+    batchDimensions[0] = trainBatchSize;
+    const MemoryPlan& encoderPlan = encoder.planMemory(batchDimensions);
+    decoder.planMemory(reparam.outputDimensions(encoderPlan.outputDimensions.back()));
+
     dtype lowestEvalLoss = 999999;
     size_t epochsWithoutImprovement = 0;
 
+    // with MYGRAD_PROFILE set, the first epoch is profiled
+    const bool profiling = std::getenv("MYGRAD_PROFILE");
+    if (profiling) {
+        encoder.name = "encoder", decoder.name = "decoder";
+        Profiler::start();
+    }
+
     for (size_t epoch = 20; epoch < epochs; epoch++) {
 
         if (epochsWithoutImprovement > trainingPatience) break;
@@ -50,6 +64,12 @@ void trainModel( Model& encoder, Model& decoder, Dataset& dataset ) {
         else if (epochsWithoutImprovement > LRpatience) optim.learningRate /= 10;
 
         trainForOneEpoch(encoder, decoder, reparam, dataset.train, trainBatchSize, epoch, optim, mse, kldiv);
+        if (profiling and Profiler::enabled()) {
+            Profiler::stop();
+            Profiler::printSummary();
+            Profiler::writeChromeTrace("../profile.json");
+            std::cout << "the trace of the first epoch has been saved to 'cats/profile.json'\n";
+        }
         auto [msevalue, kldivvalue] = validateModel(encoder, decoder, reparam, dataset.eval, evalBatchSize, mse, kldiv);
 
         if (msevalue + kldivvalue >= lowestEvalLoss) epochsWithoutImprovement++;
@@ -104,6 +124,7 @@ static std::pair<dtype, dtype> validateModel (
         MSEloss& mse, KLdivWithStandardNormal& kldiv ) {
 
     const size_t evalSize = data.dimensions[0];
+    InferenceMode inference;
 
     const std::vector<size_t> indices = shuffledIndices(evalSize);
     
@@ -63,40 +63,33 @@ static Tensor tensorWithCatData(const std::vector<size_t>& indices) {
 
     const std::string pathToDir = std::filesystem::current_path() / "../catsData/Data/"; 
 
-    const size_t threads_n = ThreadPool::size();
-    const size_t chunkSize = std::ceil(indices.size() / (double) threads_n);
-    for (size_t t=0; t < threads_n; t++) {
-        size_t start = chunkSize * t, end = std::min(start+chunkSize, indices.size()); 
-        ThreadPool::push([&, start, end] {
-            for (size_t i = start; i < end; i++) {
-        
-                int columns, rows, channels;
-                std::string filename = pathToDir + "cat_" + std::to_string( indices[i] ) + ".png";
-                unsigned char* data = stbi_load(filename.c_str(), &columns, &rows, &channels, 3);  
-                // array laid out contiguously as [rows, columns, channels]
-        
-                if (!data) throw std::runtime_error("failed to load image at " + filename + "\nrun the program from the build directory");
-        
-                if (columns != expectedSize or rows != expectedSize or channels != expectedChannels) {
-                    throw std::runtime_error("data appears to have been read incorrectly, dimensions do not match");
-                }
-                
-        
-                for (size_t channel = 0; channel < channels; channel++) {
-                    for (size_t row = 0; row < rows; row++) {
-                        for (size_t col = 0; col < columns; col++) {
-                            size_t locInData = row*columns*channels + col*channels + channel;
-                            dataTensor.at({i, channel, row, col}) = data[locInData];
-                        } 
-                    }
+    parallelFor(0, indices.size(), 1, [&] (size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) {
+    
+            int columns, rows, channels;
+            std::string filename = pathToDir + "cat_" + std::to_string( indices[i] ) + ".png";
+            unsigned char* data = stbi_load(filename.c_str(), &columns, &rows, &channels, 3);  
+            // array laid out contiguously as [rows, columns, channels]
+    
+            if (!data) throw std::runtime_error("failed to load image at " + filename + "\nrun the program from the build directory");
+    
+            if (columns != expectedSize or rows != expectedSize or channels != expectedChannels) {
+                throw std::runtime_error("data appears to have been read incorrectly, dimensions do not match");
+            }
+            
+    
+            for (size_t channel = 0; channel < channels; channel++) {
+                for (size_t row = 0; row < rows; row++) {
+                    for (size_t col = 0; col < columns; col++) {
+                        size_t locInData = row*columns*channels + col*channels + channel;
+                        dataTensor.at({i, channel, row, col}) = data[locInData];
+                    } 
                 }
-                free(data);
-
             }
-        });
-    }
+            free(data);
 
-    ThreadPool::waitUntilDone();
+        }
+    });
 
     return dataTensor;
 }
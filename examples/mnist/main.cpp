@@ -1,6 +1,7 @@
 #include <iostream>
 #include <array>
 #include <filesystem>
+#include <fstream>
 
 #include "mygrad/mygrad.hpp"
 
@@ -21,12 +22,11 @@ int main(int argc, char* argv[]) {
     const size_t neurons = 100;
 
     Model model (
-        LinearLayer( pixelsInImage, neurons ),
-        ReLU(),
-        LinearLayer( neurons, neurons ),
-        ReLU(),
+        LinearLayer( pixelsInImage, neurons, Activation::ReLU ),
+        LinearLayer( neurons, neurons, Activation::ReLU ),
         LinearLayer( neurons, numberOfClasses )
     );
+    model.packParameters();
 
 
     std::string mode = argv[1];
@@ -34,10 +34,15 @@ int main(int argc, char* argv[]) {
     if (mode == "train") {
         trainModel(model);
         model.save(std::filesystem::current_path() / "../model");
+#ifdef MYGRAD_THREAD_POOL_STATS
+        std::ofstream(std::filesystem::current_path() / "../threadPoolStats.json") << ThreadPool::statsJson();
+#endif
     } else if (mode == "test") {
+        InferenceMode inference;
         model.load(std::filesystem::current_path() / "../model");
         testModel(model);
     } else if (mode == "show") {
+        InferenceMode inference;
         model.load(std::filesystem::current_path() / "../model");
         showModel(model);
     } else {
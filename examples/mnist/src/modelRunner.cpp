@@ -21,7 +21,11 @@ void trainModel(Model& model) {
     CrossEntropyLoss loss;
     Adam optim(model.parameters, 0.001);
 
-    train(model, standartizedImages, labels, loss, optim, 64);
+    // the outputs of the layers share memory where their lives allow
+    const size_t batchSize = 64;
+    model.planMemory({ batchSize, static_cast<size_t>(standartizedImages.strides[0]) });
+
+    train(model, standartizedImages, labels, loss, optim, batchSize);
 }
 
 
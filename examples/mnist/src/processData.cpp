@@ -82,7 +82,7 @@ void visualizeImage(const Tensor& images, size_t index) {
             else {
                 pixel = images.at({index, r, c});
             };
-            pixel = std::max(0.0, std::min(1.0, pixel));
+            pixel = std::max<dtype>(0, std::min<dtype>(1, pixel));
             size_t level = (pixel * (strlen(grayRamp) - 1));
             std::cout << grayRamp[level];
         }
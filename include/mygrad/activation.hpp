@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cmath>
+#include "types.hpp"
+
+namespace mygrad {
+
+// an activation a layer applies to its own output (see Conv2d and LinearLayer), so no separate ReLU or Sigmoid
+// layer has to make another pass over memory with an output tensor of its own
+enum class Activation { None, ReLU, Sigmoid };
+
+inline dtype activate( Activation activation, dtype x ) {
+    switch (activation) {
+        case Activation::ReLU:    return x >= 0 ? x : 0;
+        case Activation::Sigmoid: return 1 / (1 + std::exp(-x));
+        default:                  return x;
+    }
+}
+
+// the derivative in terms of the activation's output, as the input isn't kept. for ReLU that makes it 0
+// at an input of exactly 0, as it is in the ReLU layer
+inline dtype activationDerivative( Activation activation, dtype y ) {
+    switch (activation) {
+        case Activation::ReLU:    return y > 0 ? 1 : 0;
+        case Activation::Sigmoid: return y * (1 - y);
+        default:                  return 1;
+    }
+}
+
+} // namespace mygrad
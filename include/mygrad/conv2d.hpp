@@ -1,16 +1,18 @@
 #pragma once
 
 #include "layers.hpp"
-#include <mutex>
+#include "activation.hpp"
 
 namespace mygrad {
 
 struct Conv2d : Layer {
     const size_t inChannels, outChannels, kernelSize, stride, paddingSize;
+    const Activation activation; // applied to the output, in place of a following ReLU or Sigmoid layer
     Tensor kernels;
     Tensor biases;
 
-    Conv2d( size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride, size_t paddingSize = 0 );
+    Conv2d( size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride, size_t paddingSize = 0,
+            Activation activation = Activation::None );
 
     void print();
 
@@ -19,19 +21,79 @@ struct Conv2d : Layer {
 
     std::vector<Tensor*> parameterTensors() override { return { &kernels, &biases }; }
     std::vector<Tensor*> nonParameterTensors() override { return { &outputTensor }; }
+    const char* name() const override { return "Conv2d"; }
+    PassCost forwardCost() const override; // counted as a direct convolution, whichever path runs
+    PassCost backwardCost() const override;
+    TensorDims outputDimensions( const TensorDims& inputDimensions ) const override;
+    bool backwardReadsOutput() const override { return activation != Activation::None; }
+
+    // the buffers of the im2col and winograd paths (with their grads) are kept under this many bytes by
+    // working through the batch in chunks, so memory use doesn't grow with the batch size
+    static size_t workspaceMemoryLimit;
+
+protected:
+    // the input is read as if it had been nearest-upsampled by this factor first, without ever storing the
+    // upsampled version. 1 for a plain convolution
+    const size_t upsamplingFactor;
+
+    Conv2d( size_t upsamplingFactor, size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride, size_t paddingSize,
+            Activation activation );
 
 private:
-    std::vector<std::mutex> kernelMutexes;
+    // offsets into an input channel of every row (rows) and column (cols) a patch or tile can touch, indexed from
+    // -paddingSize, so the bounds checks and the upsampling division happen once per pass. -1 marks padding
+    struct SourceOffsets { std::vector<int> rows, cols; };
+    SourceOffsets sourceOffsets( const Tensor& inputTensor, size_t rowsTouched, size_t colsTouched ) const;
+
+    Tensor matrixFormInput;  // a chunk of the im2col matrix: one row per output pixel, one column per kernel weight
+    Tensor matrixFormOutput; // the same chunk of the output as [picture and pixel, channel]
+    // the grads of both hold the grads of their contents in backward
+
+    size_t matrixFormChunkRows();
+    void im2col( const Tensor& inputTensor, size_t firstRow, size_t rows );
+    void movePatchToMatrixForm( size_t picture, size_t patchTop, size_t patchLeft, const SourceOffsets& offsets, size_t rowInMatrixForm );
+    void matrixFormToOutput( size_t firstRow, size_t rows );
+
+    void outputGradsToMatrixForm( size_t firstRow, size_t rows );
+    void col2im( Tensor& inputTensor, size_t firstRow, size_t rows );
+    void movePatchGradsFromMatrixForm( size_t picture, size_t inputChannel, size_t patchTop, size_t patchLeft, const SourceOffsets& offsets, size_t rowInMatrixForm );
+    void activationAndBiasGrads();
 
-    Tensor matrixFormInput;
+    // winograd F(2x2, 3x3): every 2x2 block of the output is computed from a 4x4 input tile with 16 multiplications
+    // per channel pair instead of 36. used instead of im2col for 3x3 kernels with stride 1.
+    // the grads of each buffer hold the grads of its contents in backward
+    Tensor winogradKernels; // [16, outChannels, inChannels]
+    Tensor winogradInput;   // [16, inChannels, tiles of a chunk of pictures]
+    Tensor winogradOutput;  // [16, outChannels, tiles of a chunk of pictures]
 
-    void im2col( const Tensor& inputTensor );
-    void movePatchToMatrixForm( size_t picture, int leftUpperRow, int leftUpperCol, Tensor& matrixFormTensor, size_t rowInMatrixForm );
+    constexpr bool usesWinograd() const noexcept { return kernelSize == 3 and stride == 1; }
+    void winogradForward( const Tensor& inputTensor );
+    void winogradBackward( Tensor& inputTensor );
+    size_t winogradChunkPictures();
+    void transformKernels();
+    void transformKernelGrads();
+    void transformInput( const Tensor& inputTensor, size_t firstPicture, size_t pictures );
+    void transformInputGrads( Tensor& inputTensor, size_t firstPicture, size_t pictures );
+    void transformOutput( size_t firstPicture, size_t pictures );
+    void transformOutputGrads( size_t firstPicture, size_t pictures );
+    void winogradMultiply( size_t tiles );
+    void winogradMultiplyBackward( size_t tiles, bool accumulateKernelGrads );
     
-    constexpr size_t convolvedSize( size_t size ) noexcept { return (size + 2*paddingSize - kernelSize)/stride + 1; } 
-    void convolveBackward(size_t pictureIndex, size_t filterIndex, int inputRow, int inputCol, dtype gradPassedDown);
+    constexpr size_t convolvedSize( size_t size ) const noexcept { return (size + 2*paddingSize - kernelSize)/stride + 1; } 
+};
+
+
+// Upsample(scalingFactor) followed by Conv2d(inChannels, outChannels, kernelSize, stride, paddingSize), with the same
+// parameters (so models saved with the two separate layers load into it), but the upsampled activation is never stored:
+// forward and backward both index the low-resolution input directly while gathering patches
+struct UpsampleConv2d : Conv2d {
+    const size_t scalingFactor;
 
-    inline void manageDimensions( const Tensor& inputTensor ) override;
+    UpsampleConv2d( size_t scalingFactor, size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride, size_t paddingSize = 0,
+                    Activation activation = Activation::None );
+
+    const char* name() const override { return "UpsampleConv2d"; }
+    void print();
 };
 
 } // namespace mygrad
\ No newline at end of file
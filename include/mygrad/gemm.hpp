@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include "types.hpp"
+#include "activation.hpp"
+
+namespace mygrad {
+
+enum class Transpose { No, Yes };
+
+// C = op(A) * op(B) + bias, all matrices row-major. op(A) is M x K, op(B) is K x N, C is M x N.
+// with transA == Yes, A is stored as K x M (and likewise B as N x K with transB == Yes),
+// so the variants for both the forward pass (X * W^T) and the gradients (dY * W, dY^T * X)
+// are covered without copying anything.
+// accumulate adds the product to C instead of overwriting it. bias, if given, has N entries
+// and is added to every row of C. activation is applied to the final value of every element of C
+// while its tile is still in registers.
+// the work is split over the thread pool by blocks of C: every element of C is written by exactly
+// one job, so accumulating into C needs no locking.
+void gemm( Transpose transA, Transpose transB,
+           size_t M, size_t N, size_t K,
+           const dtype* A, size_t lda,
+           const dtype* B, size_t ldb,
+           dtype* C, size_t ldc,
+           bool accumulate, const dtype* bias = nullptr, Activation activation = Activation::None );
+
+} // namespace mygrad
@@ -1,12 +1,19 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <iostream>
 #include "types.hpp"
 #include "tensor.hpp"
 
 namespace mygrad {
 
+// seeds the generators behind the weights of new layers, the noise of layers made without a seed of their own and
+// shuffledIndices, which are seeded at random otherwise
+void setSeed(uint64_t seed);
+// a seed for a layer's generator of its own, drawn from the one behind the weights, so setSeed decides it too
+uint64_t layerSeed();
+
 std::vector<dtype> normDistVector(size_t length, dtype standardDeviation = 1);
 std::vector<dtype> KaimingWeightsVector(size_t inFeatures, size_t outFeatures);
 
@@ -2,9 +2,10 @@
 
 #include <vector>
 #include <optional>
-#include <random>
 #include "tensor.hpp" 
 #include "helper.hpp"
+#include "profiler.hpp"
+#include "random.hpp"
 
 namespace mygrad {
 
@@ -22,12 +23,29 @@ struct Layer {
     virtual std::vector<Tensor*> parameterTensors()    = 0;
     virtual std::vector<Tensor*> nonParameterTensors() = 0;
 
+    // for the profiler: the layer's kind, and the rough work of a pass at the shapes of the last forward.
+    // by default one operation per element, reading the input and writing the output
+    virtual const char* name() const { return "Layer"; }
+    virtual PassCost forwardCost() const;
+    virtual PassCost backwardCost() const;
+
     Tensor& operator()( Tensor& inputTensor ) { forward(inputTensor); return outputTensor; };
     void zeroGrad();
+
+    // the dimensions of the output for an input of these dimensions, throwing if the layer can't take it
+    virtual TensorDims outputDimensions( const TensorDims& inputDimensions ) const = 0;
+
+    // what backward reads back from the forward pass, besides the grads, for Model::planMemory: an output that
+    // nothing reads any more can share its memory with ones made later. both by default, which is always safe
+    virtual bool backwardReadsInput() const { return true; }
+    virtual bool backwardReadsOutput() const { return true; }
+
+    // whether forward gives the same output for the same input, so Model::checkpoint can run it again
+    virtual bool deterministic() const { return true; }
     
 protected:
     void setInputTensorPointer( Tensor* inputTensor ); // relies on the input tensor not changing
-    virtual void manageDimensions( const Tensor& inputTensor ) = 0; 
+    virtual void manageDimensions( const Tensor& inputTensor ); // reallocates the output when it doesn't fit any more
     void adjustOutTensorDimensions( const TensorDims& newDimensions );
 };
 
@@ -40,9 +58,9 @@ struct ReLU : Layer {
     void backward() override;
     std::vector<Tensor*> parameterTensors() override { return {}; }
     std::vector<Tensor*> nonParameterTensors() override { return { &outputTensor }; }
-
-private:
-    inline void manageDimensions( const Tensor& inputTensor ) override;
+    const char* name() const override { return "ReLU"; }
+    TensorDims outputDimensions( const TensorDims& inputDimensions ) const override { return inputDimensions; }
+    bool backwardReadsOutput() const override { return false; }
 
 };
 
@@ -55,9 +73,9 @@ struct Sigmoid : Layer {
     void backward() override;
     std::vector<Tensor*> parameterTensors() override { return {}; }
     std::vector<Tensor*> nonParameterTensors() override { return { &outputTensor }; }
-
-private:
-    inline void manageDimensions( const Tensor& inputTensor ) override;
+    const char* name() const override { return "Sigmoid"; }
+    TensorDims outputDimensions( const TensorDims& inputDimensions ) const override { return inputDimensions; }
+    bool backwardReadsInput() const override { return false; }
 
 };
 
@@ -74,10 +92,14 @@ struct Reshape : Layer {
     
     std::vector<Tensor*> parameterTensors() override { return {}; }
     std::vector<Tensor*> nonParameterTensors() override { return { &outputTensor }; }
+    const char* name() const override { return "Reshape"; }
+    TensorDims outputDimensions( const TensorDims& inputDimensions ) const override;
+    bool backwardReadsInput() const override { return false; }
+    bool backwardReadsOutput() const override { return false; }
     
 private:
 
-    inline void manageDimensions( const Tensor& inputTensor ) override;
+    void manageDimensions( const Tensor& inputTensor ) override;
 };
 
 
@@ -91,10 +113,10 @@ struct Upsample : Layer {
     
     std::vector<Tensor*> parameterTensors() override { return {}; }
     std::vector<Tensor*> nonParameterTensors() override { return { &outputTensor }; }
-    
-private:
-
-    inline void manageDimensions( const Tensor& inputTensor ) override;
+    const char* name() const override { return "Upsample"; }
+    TensorDims outputDimensions( const TensorDims& inputDimensions ) const override;
+    bool backwardReadsInput() const override { return false; }
+    bool backwardReadsOutput() const override { return false; }
 };
 
 
@@ -109,31 +131,36 @@ struct MaxPool2d : Layer {
     
     std::vector<Tensor*> parameterTensors() override { return {}; }
     std::vector<Tensor*> nonParameterTensors() override { return { &outputTensor }; }
+    const char* name() const override { return "MaxPool2d"; }
+    TensorDims outputDimensions( const TensorDims& inputDimensions ) const override;
+    bool backwardReadsOutput() const override { return false; }
     
 private:
     dtype pool(size_t pictureIndex, size_t filterIndex, size_t inputRow, size_t inputCol) const;
     void poolBackward(size_t pictureIndex, size_t channelIndex, size_t inputRow, size_t inputCol, dtype gradPassedDown);
-
-    inline void manageDimensions( const Tensor& inputTensor ) override;
 };
 
 
 struct Reparameterize : Layer {
 
-    Reparameterize() : generator(std::random_device()()), currentEpsilons(Tensor::zeros({1})) {};
+    Reparameterize() : Reparameterize(layerSeed()) {};
+    explicit Reparameterize( uint64_t seed ) : currentEpsilons(Tensor::zeros({1})), generator(seed) {};
 
     void forward( Tensor& inputTensor ) override;
     void backward() override;
 
     std::vector<Tensor*> parameterTensors() override { return {}; }
     std::vector<Tensor*> nonParameterTensors() override { return { &outputTensor, &currentEpsilons }; }
+    const char* name() const override { return "Reparameterize"; }
+    TensorDims outputDimensions( const TensorDims& inputDimensions ) const override;
+    bool backwardReadsOutput() const override { return false; }
+    bool deterministic() const override { return false; }
 
 private:
     Tensor currentEpsilons; // for backprop
-    std::mt19937 generator;
-    std::normal_distribution<dtype> normDist {0, 1};
+    Philox generator;
 
-    inline void manageDimensions( const Tensor& inputTensor ) override;
+    void manageDimensions( const Tensor& inputTensor ) override;
 };
 
 
@@ -1,7 +1,7 @@
 #pragma once 
 
-#include <mutex>
 #include "layers.hpp"
+#include "activation.hpp"
 
 namespace mygrad {
 
@@ -9,18 +9,19 @@ struct LinearLayer : Layer {
 
     Tensor weights;
     Tensor biases;
+    const Activation activation; // applied to the output, in place of a following ReLU or Sigmoid layer
     
-    LinearLayer( size_t inFeatures, size_t outFeatures);
-    LinearLayer( size_t inFeatures, size_t outFeatures, const std::vector<dtype>& data);
+    LinearLayer( size_t inFeatures, size_t outFeatures, Activation activation = Activation::None );
+    LinearLayer( size_t inFeatures, size_t outFeatures, const std::vector<dtype>& data, Activation activation = Activation::None );
     void forward( Tensor& inputTensor ) override;
     void backward() override;
     std::vector<Tensor*> parameterTensors() override { return { &weights, &biases }; }
     std::vector<Tensor*> nonParameterTensors() override { return { &outputTensor }; }
-    
-private:
-
-    std::vector<std::mutex> weightRowMutexes;
-    void manageDimensions( const Tensor& inputTensor ) override; 
+    const char* name() const override { return "LinearLayer"; }
+    PassCost forwardCost() const override;
+    PassCost backwardCost() const override;
+    TensorDims outputDimensions( const TensorDims& inputDimensions ) const override;
+    bool backwardReadsOutput() const override { return activation != Activation::None; }
 };
 
 } // namespace mygrad
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "types.hpp"
 
 #include <string>
+#include <vector>
 
 namespace mygrad {
 
@@ -20,6 +21,7 @@ private:
     const Tensor* labels = nullptr;
     Tensor* logits = nullptr;
     Tensor currentSoftmaxOutput;
+    std::vector<dtype> rowLosses; // kept between calls, so a forward allocates nothing once the batch size settles
 
     void setInputPointers( Tensor* logits, const Tensor* labels ) { this->logits = logits, this->labels = labels; } 
     inline void checkDimensions( Tensor& logits, const Tensor& labels );
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include "types.hpp"
+
+namespace mygrad {
+
+// where the memory of tensors comes from and goes back to. a freed block is kept for the next tensor of its size
+// class instead of going back to the system, so buffers reallocated for another shape (a layer's output when the
+// batch size changes between training and evaluation, a ragged last batch, the workspaces of Conv2d, the
+// temporaries of the losses) come out of the cache once every shape has been seen. the size classes are four to a
+// power of two, so a block is at most a quarter bigger than asked for, and a smaller request may take a free block
+// of up to twice its size class.
+// blocks over limitBytes of cached memory go back to the system. safe to use from any thread
+class MemoryCache {
+public:
+    struct Stats {
+        size_t hits = 0;        // blocks handed out from the cache
+        size_t misses = 0;      // blocks allocated from the system
+        size_t releases = 0;    // blocks freed to the system, over the limit or by emptyCache
+        size_t usedBytes = 0;   // handed out and not freed yet
+        size_t cachedBytes = 0; // kept for reuse
+    };
+
+    // a zeroed block of length elements or more. capacity is set to what it really holds, which release needs
+    static dtype* allocate( size_t length, size_t& capacity );
+    static void release( dtype* memory, size_t capacity );
+
+    // frees every cached block to the system
+    static void emptyCache();
+
+    static Stats stats();
+    static void resetStats(); // the counts, not what's used or cached
+
+    static size_t limitBytes;
+};
+
+} // namespace mygrad
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <optional>
 
 #include "tensor.hpp"
 #include "layers.hpp"
@@ -9,6 +10,26 @@
 
 namespace mygrad {
 
+// where Model::planMemory put the outputs of the layers, all in one arena
+struct MemoryPlan {
+    TensorDims inputDimensions;
+    bool withGrads = true;                               // planned in grad mode, or in inference mode
+    std::vector<TensorDims> outputDimensions {};         // one for each layer
+    std::vector<size_t> dataOffsets {}, gradsOffsets {}; // into the arena, in values
+    size_t naiveBytes = 0;   // the outputs with memory of their own each, as without a plan
+    size_t plannedBytes = 0; // the arena
+};
+
+// layers firstLayer to lastLayer of a model, of which all but the last are run again by backward, see Model::checkpoint
+struct CheckpointedSegment {
+    size_t firstLayer, lastLayer;
+    size_t savedBytes = 0;       // how much smaller the arena is with this segment than without any, set by planMemory
+    double recomputeFlops = 0;   // of running the segment again, in the last backward,
+    double forwardFlops = 0;     // and of the whole forward before it
+    double recomputeSeconds = 0; // of all the runs so far
+    size_t recomputes = 0;
+};
+
 class Model {
 public:
 
@@ -22,6 +43,31 @@ public:
     void save(const std::string& filename) const;
     void load(const std::string& filename);
     void zeroGrad();
+
+    // moves the data of all the parameters into one cache line aligned buffer owned by the model and their grads into
+    // another, laid end to end, with the parameter tensors as views into them. zeroGrad then clears the grads with one
+    // memset, Adam goes through them in one run and save and load write and read each buffer in one go. the values
+    // stay as they are, and it can be called at any time, once
+    void packParameters();
+    bool packed() const { return packedData != nullptr; }
+
+    // plans the memory of the layers' outputs for inputs of these dimensions. an output lives from the forward that
+    // writes it to the last pass that reads it: the next layer's forward, and in grad mode the backward passes that
+    // read it back too (see Layer::backwardReadsInput), with its grads living from the backward that writes them
+    // to the one that reads them. outputs whose lives don't overlap share memory in one arena, so inference goes
+    // back and forth between two buffers and training puts grads where backward is done with outputs.
+    // a plan made in grad mode serves both modes, one made in inference mode only that. forwards with other input
+    // dimensions give the layers memory of their own, until one with the planned dimensions comes again
+    const MemoryPlan& planMemory( const TensorDims& inputDimensions );
+    const std::optional<MemoryPlan>& memoryPlan() const { return plan; }
+
+    // gradient checkpointing: the outputs of layers firstLayer to lastLayer - 1 aren't kept for backward, which runs
+    // the forward of those layers again, from the output before them, right before lastLayer's backward. it takes a
+    // memory plan made in grad mode after this, which gives their memory to other outputs in the meantime, and pays
+    // off when many outputs would be alive at once at the start of backward. segments can't share layers and the
+    // ones run again have to be deterministic, so no Reparameterize
+    void checkpoint( size_t firstLayer, size_t lastLayer );
+    const std::vector<CheckpointedSegment>& checkpointedSegments() const { return segments; }
     Tensor& operator()(Tensor& x);
     Tensor& forward(Tensor& x);
     void backward();
@@ -31,6 +77,17 @@ public:
 
 private:
 
+    struct AlignedDeleter { void operator()( dtype* memory ) const; };
+
+    // declared before the layers, so the tensors that are views into them are gone first
+    std::unique_ptr<dtype[], AlignedDeleter> packedData, packedGrads, activationArena;
+    std::optional<MemoryPlan> plan;
+    std::vector<CheckpointedSegment> segments; // in the order of their layers
+    bool forwardOnPlan = false; // the last forward ran in grad mode on a plan made in grad mode, so backward recomputes
+
+    void usePlannedMemory();
+    void recompute( CheckpointedSegment& segment );
+
     class LayersContainer {
     public:
 
@@ -62,6 +119,7 @@ public:
     LayersContainer layers;
     const std::vector<Tensor*> parameters;
     const std::vector<Tensor*> nonParameters;
+    std::string name; // prefixes the names of the layers in the profiler's results
 };
 
 } // namespace mygrad
\ No newline at end of file
@@ -1,12 +1,17 @@
 #pragma once 
 
+#include "mygrad/activation.hpp"
 #include "mygrad/conv2d.hpp"
+#include "mygrad/gemm.hpp"
 #include "mygrad/helper.hpp"
 #include "mygrad/layers.hpp"
 #include "mygrad/linearLayer.hpp"
 #include "mygrad/loss.hpp"
+#include "mygrad/memoryCache.hpp"
 #include "mygrad/model.hpp"
 #include "mygrad/optim.hpp"
+#include "mygrad/profiler.hpp"
+#include "mygrad/random.hpp"
 #include "mygrad/tensor.hpp"
 #include "mygrad/types.hpp"
 #include "mygrad/threadPool.hpp"
@@ -27,25 +27,14 @@ private:
     dtype weightDecay;
     int stepsMade = 0;
 
+    std::vector<Tensor*> parameters;
+    std::vector<size_t> offsets; // where each tensor starts when they're all laid end to end, and the total at the back
 
-    struct dataAndGrads {
-        dtype& data, & grad;
-        dtype gradRunAvg, gradSqRunAvg;
+    // the running averages of the grads and of their squares, of all the parameters laid end to end
+    std::vector<dtype> firstMoments, secondMoments;
 
-        dataAndGrads(dtype& data, dtype& grad) : 
-            data(data), grad(grad), 
-            gradRunAvg(0), gradSqRunAvg(0) {}
-    };
-
-    std::vector<dataAndGrads> paramsAndGrads;
-
-    inline size_t sizeOfParamsAndGradsFromParameters(std::vector<Tensor*> parameters) const {
-        size_t size = 0;
-        for (const Tensor *const param : parameters){
-            size += param->length;
-        }
-        return size;
-    }
+    // whether the tensor after this one carries on where it stops in memory, as in a packed Model
+    bool continuesInMemory( size_t tensor ) const;
 
 };
 
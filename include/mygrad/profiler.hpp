@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include "types.hpp"
+
+namespace mygrad {
+
+// rough amount of work of one pass of a layer, loss or optimizer, for the profiler
+struct PassCost {
+    double flops = 0;
+    double bytes = 0; // read and written, counting every tensor once
+};
+
+// a few operations per element, touching tensorsTouched tensors of that length
+inline PassCost elementwiseCost( size_t elements, double operationsPerElement, size_t tensorsTouched ) {
+    return { elements * operationsPerElement, static_cast<double>(elements * tensorsTouched * sizeof(dtype)) };
+}
+
+// records what runs where while it's on: every pass of a layer run by a Model, the losses, Adam::step and every
+// thread pool job, with wall time, cost and the bytes of tensors allocated inside. the results are a summary table
+// and a trace for chrome://tracing or ui.perfetto.dev with one track per thread.
+// off, a scope costs a single flag check. the results must only be read once stop() has returned and nothing
+// runs on the pool any more
+class Profiler {
+public:
+    static void start();
+    static void stop();
+    static void clear();
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+
+    static void printSummary( std::ostream& out = std::cout );
+    static void writeChromeTrace( const std::string& filename );
+
+    // the name of the calling thread's track in the trace
+    static void nameThread( std::string name );
+
+    // the tensors allocated while a scope is open are put down to the innermost one
+    static void recordAllocation( size_t bytes ) { if (enabled()) addAllocation(bytes); }
+
+    class Scope {
+    public:
+        Scope( std::string_view name, const char* category );
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        // set before the scope closes, usually once the pass has run and the shapes are known
+        void setCost( PassCost cost ) { this->cost = cost; }
+        bool active() const { return startedAt >= 0; }
+
+    private:
+        std::string name;
+        const char* category;
+        int64_t startedAt = -1;
+        PassCost cost;
+        size_t allocatedBytes = 0, allocations = 0;
+        Scope* outer = nullptr;
+
+        friend class Profiler;
+    };
+
+private:
+    static inline std::atomic<bool> on {false};
+    static void addAllocation( size_t bytes );
+};
+
+} // namespace mygrad
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp"
+
+namespace mygrad {
+
+// philox 4x32-10 (salmon et al., "parallel random numbers: as easy as 1, 2, 3"), a counter based generator: every
+// block of 4 numbers is a function of the key and the block's index only, so a long run of them can be split over
+// the thread pool, skipping ahead costs nothing and the numbers for a seed are the same whatever the thread count.
+// a generator is only its seed and the index of the next block, and every call starts on a block of its own
+class Philox {
+public:
+    using Block = std::array<uint32_t, 4>;
+
+    explicit Philox( uint64_t seed ) : key(seed) {}
+
+    void seed( uint64_t seed ) { key = seed, position = 0; }
+    void discard( uint64_t blocks ) { position += blocks; }
+
+    // 64 uniformly distributed bits
+    uint64_t bits() {
+        const Block numbers = block(position++, key);
+        return (uint64_t(numbers[0]) << 32) | numbers[1];
+    }
+
+    // normally distributed numbers, from the uniform ones with box muller
+    void normal( dtype* output, size_t length, dtype mean = 0, dtype standardDeviation = 1 );
+
+    // a float takes a 32 bit number, a double two of them
+    static constexpr size_t NORMALS_PER_BLOCK = sizeof(dtype) == sizeof(float) ? 4 : 2;
+
+    static Block block( uint64_t counter, uint64_t key ) {
+        uint32_t c0 = static_cast<uint32_t>(counter), c1 = static_cast<uint32_t>(counter >> 32), c2 = 0, c3 = 0;
+        uint32_t k0 = static_cast<uint32_t>(key), k1 = static_cast<uint32_t>(key >> 32);
+        for (int round = 0; round < 10; round++) {
+            const uint64_t product0 = uint64_t(0xD2511F53) * c0, product1 = uint64_t(0xCD9E8D57) * c2;
+            const uint32_t next0 = static_cast<uint32_t>(product1 >> 32) ^ c1 ^ k0, next2 = static_cast<uint32_t>(product0 >> 32) ^ c3 ^ k1;
+            c1 = static_cast<uint32_t>(product1), c3 = static_cast<uint32_t>(product0);
+            c0 = next0, c2 = next2;
+            k0 += 0x9E3779B9, k1 += 0xBB67AE85;
+        }
+        return { c0, c1, c2, c3 };
+    }
+
+private:
+    uint64_t key, position = 0;
+};
+
+// 64 bits from std::random_device, for a seed that differs from run to run
+uint64_t randomSeed();
+
+} // namespace mygrad
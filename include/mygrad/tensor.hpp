@@ -4,6 +4,7 @@
 #include <cstring>
 #include <vector>
 #include "smallArray.hpp"
+#include "memoryCache.hpp"
 #include "types.hpp"
 
 
@@ -14,13 +15,48 @@ using TensorDims = SmallArray<size_t, MAX_TENSOR_DIMENSIONALITY>;
 using TensorIndices = TensorDims;
 using TensorStrides = SmallArray<int, MAX_TENSOR_DIMENSIONALITY>;
 
+// gives the memory of a tensor back to the MemoryCache, unless the tensor is a view into memory owned by something
+// else (see moveInto)
+struct TensorMemoryDeleter {
+    bool owning = true;
+    size_t capacity = 0; // of the block from the cache
+    void operator()( dtype* memory ) const { if (owning) MemoryCache::release(memory, capacity); }
+};
+using TensorMemory = std::unique_ptr<dtype[], TensorMemoryDeleter>;
+
+// whether new tensors come with grads, for each thread on its own. on, unless an InferenceMode is alive
+class GradMode {
+public:
+    static bool enabled() { return on; }
+
+private:
+    static inline thread_local bool on = true;
+    friend class InferenceMode;
+};
+
+// turns grads off on the calling thread for as long as it's alive, for passes that no backward follows (testing,
+// generating): tensors made meanwhile have no grads (grads is null), which halves the memory of the layers' outputs,
+// the batches and the temporaries, and layers don't keep what only backward needs. the layers' outputs get their
+// grads back in the first forward after it. can be nested
+class InferenceMode {
+public:
+    InferenceMode() : previous(GradMode::on) { GradMode::on = false; }
+    ~InferenceMode() { GradMode::on = previous; }
+
+    InferenceMode(const InferenceMode&) = delete;
+    InferenceMode& operator=(const InferenceMode&) = delete;
+
+private:
+    bool previous;
+};
+
 struct Tensor {
     size_t length;
     
     TensorDims dimensions;
     TensorStrides strides;
-    std::unique_ptr<dtype[]> data;
-    std::unique_ptr<dtype[]> grads;
+    TensorMemory data;
+    TensorMemory grads;
 
     Tensor( const std::vector<dtype>& dataVector,
             const TensorDims& dimensions );
@@ -34,9 +70,12 @@ struct Tensor {
 
 private:
     Tensor( const TensorDims& dimensions );
+    Tensor( const TensorDims& dimensions, TensorMemory data, TensorMemory grads );
 public:
 
     static Tensor zeros( const TensorDims& dimensions );
+    // a tensor over memory owned by something else, which has to outlive it. grads may be null, as in inference mode
+    static Tensor view( dtype* data, dtype* grads, const TensorDims& dimensions );
 
     void print() const;
     void printGrad() const;
@@ -55,7 +94,21 @@ public:
         strides = stridesFromDimensions(newDimensions);
     }
 
-    void zeroGrad() { std::memset(grads.get(), 0, length*sizeof(dtype)); }
+    void zeroGrad() { if (grads) std::memset(grads.get(), 0, length*sizeof(dtype)); }
+
+    bool hasGrads() const { return grads != nullptr; }
+    void allocateGrads(); // zeroed grads for a tensor made in inference mode, whatever the mode is now
+
+    // whether a buffer kept from one pass to the next can take a result of these dimensions as it is. it can't when
+    // it was made in inference mode and grads are on again
+    bool fits( const TensorDims& neededDimensions ) const {
+        return dimensions == neededDimensions and (grads or !GradMode::enabled());
+    }
+
+    // copies the data and grads over to memory owned by something else, which has to outlive the tensor, and keeps
+    // them there from then on. see Model::packParameters
+    void moveInto( dtype* newData, dtype* newGrads );
+    bool isView() const { return !data.get_deleter().owning; }
 
 
     static TensorStrides stridesFromDimensions(const TensorDims& dimensions);
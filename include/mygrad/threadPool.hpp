@@ -3,40 +3,269 @@
 #include <atomic>
 #include <vector>
 #include <thread>
-#include <queue>
-#include <mutex>
-#include <functional>
-#include <condition_variable>
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <type_traits>
 
 namespace mygrad {
 
+class TaskGroup;
+
+// a job stored in place: the callable lives in a fixed buffer instead of on the heap, so pushing never allocates.
+// lambdas capturing more than STORAGE_SIZE bytes don't compile; capture a reference to a struct instead.
+// a job is moved out of its deque's slot into a Task on the stack of the thread that runs it, so the slot takes a
+// new job right away
+class Task {
+public:
+    static constexpr size_t STORAGE_SIZE = 96;
+
+    TaskGroup* group = nullptr; // the group the job counts towards, if any
+#ifdef MYGRAD_THREAD_POOL_STATS
+    int64_t pushedAt = 0;       // steady clock nanoseconds
+#endif
+
+    template <typename Function>
+    void emplace( Function&& function ) {
+        using Callable = std::decay_t<Function>;
+        static_assert(sizeof(Callable) <= STORAGE_SIZE, "job captures too much to be stored in a Task");
+        static_assert(alignof(Callable) <= alignof(std::max_align_t), "job is over-aligned for a Task");
+
+        new (storage) Callable(std::forward<Function>(function));
+        runAndDestroy = [] (void* callable) {
+            struct Destroy { Callable* callable; ~Destroy() { callable->~Callable(); } } destroy { static_cast<Callable*>(callable) };
+            (*destroy.callable)();
+        };
+        relocate = [] (void* from, void* to) {
+            Callable* callable = static_cast<Callable*>(from);
+            new (to) Callable(std::move(*callable));
+            callable->~Callable();
+        };
+    }
+
+    void run() { runAndDestroy(storage); }
+
+    // moves the job over to destination, which must be empty, and leaves this one empty
+    void relocateTo( Task& destination ) {
+        relocate(storage, destination.storage);
+        destination.runAndDestroy = runAndDestroy, destination.relocate = relocate;
+        destination.group = group;
+#ifdef MYGRAD_THREAD_POOL_STATS
+        destination.pushedAt = pushedAt;
+#endif
+    }
+
+private:
+    alignas(std::max_align_t) std::byte storage[STORAGE_SIZE];
+    void (*runAndDestroy)(void*) = nullptr;
+    void (*relocate)(void*, void*) = nullptr;
+};
+
+
+// work-stealing pool: every worker owns a deque (Chase-Lev) that it pushes to and pops from at the bottom, while the
+// others steal from the top. threads outside the pool get a deque of their own on their first push.
+// a thread that waits, in waitUntilDone or TaskGroup::wait, runs jobs itself until there are none left to take.
+// waitUntilDone waits for every job in the pool, so inside jobs (and wherever independent work may overlap)
+// TaskGroup or parallelFor are the ones to use. the first exception thrown by a job pushed without a group is
+// rethrown by waitUntilDone.
+// an idle thread spins for a moment, then yields, then sleeps, so back to back layers rarely pay for a wake up.
+// the pool starts on first use with one worker per hardware thread, unless configure() or the environment variables
+// MYGRAD_NUM_THREADS (the number of workers) and MYGRAD_CPU_LIST (cpus to pin them to, like "0-3,8") say otherwise
 class ThreadPool {
+    struct WorkDeque;
+
     std::vector<std::thread> threads;
-    std::queue<std::function<void()>> jobs;
-    std::mutex jobsMutex;
-    std::condition_variable jobsAvailable;
+    std::vector<std::unique_ptr<WorkDeque>> deques; // the workers' first, then the ones lent to outside threads
 
-    std::mutex doneMutex;
-    std::condition_variable allDone;
     std::atomic<size_t> jobsRemaining;
+    std::atomic<unsigned> pushes;      // bumped on every push, what sleeping workers wait on
+    std::atomic<size_t> sleepers;
+    std::atomic<unsigned> completions; // bumped whenever a job finishes, what waiting threads wait on
+    std::atomic<size_t> waiters;
+    std::atomic<bool> terminate;
+    std::atomic<bool> failed;
+    std::exception_ptr exception;      // the first thrown by a job without a group, for waitUntilDone
+
+    static thread_local WorkDeque* threadDeque; // the deque the current thread pushes to, if it has one yet
 
-    bool terminate = false;
     ThreadPool();
     ~ThreadPool();
 
     ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
-    
+
     static ThreadPool& get();
 
-    static void threadLoop();
+    static void threadLoop( size_t worker );
+    static WorkDeque* ownDeque();
+    static bool runOneJob( size_t firstVictim );
+    static bool anyJobs();
+    static void helpUntilDone( const std::atomic<size_t>& remaining );
+    static void pushTask( WorkDeque* deque );
+    static Task* reserveTask( WorkDeque* deque );
+    static void keepException( TaskGroup* group, std::exception_ptr thrown );
+
+    template <typename Function>
+    static void push( TaskGroup* group, Function&& job );
+
+    friend class TaskGroup;
 
 public:
-    static void push(std::function<void()>);
+    template <typename Function>
+    static void push( Function&& job ) { push(nullptr, std::forward<Function>(job)); }
+
+    // must come before the pool's first use, and overrides the environment. threads == 0 means one per cpu given,
+    // or per hardware thread without cpus. worker i is pinned to cpus[i % cpus.size()] (on linux, ignored elsewhere)
+    static void configure( size_t threads, std::vector<unsigned> cpus = {} );
+
     static void waitUntilDone();
     static bool busy();
     static size_t size() { return get().threads.size(); };
 
+    // per worker and pool wide counters as json: jobs run and stolen, time busy, spinning and sleeping, histograms
+    // of queue wait and job time, and the load imbalance between waits. only counted when built with
+    // MYGRAD_THREAD_POOL_STATS, otherwise the json says so and the pool pays nothing
+    static std::string statsJson();
+    static void resetStats();
+
 };
 
-} // namespace mygrad
\ No newline at end of file
+
+// a set of jobs that can be waited on by themselves: groups don't wait on each other's jobs, so they can run
+// side by side and be used from inside jobs. the first exception thrown by a job is rethrown by wait()
+class TaskGroup {
+public:
+    TaskGroup() = default;
+    ~TaskGroup() { ThreadPool::helpUntilDone(jobsRemaining); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <typename Function>
+    void run( Function&& job ) { ThreadPool::push(this, std::forward<Function>(job)); }
+
+    void wait() {
+        ThreadPool::helpUntilDone(jobsRemaining);
+        if (failed) {
+            failed = false;
+            std::rethrow_exception(std::exchange(exception, nullptr));
+        }
+    }
+
+private:
+    std::atomic<size_t> jobsRemaining {0};
+    std::atomic<bool> failed {false};
+    std::exception_ptr exception;
+
+    void keepException( std::exception_ptr thrown ) {
+        if (!failed.exchange(true)) exception = thrown;
+    }
+
+    friend class ThreadPool;
+};
+
+
+template <typename Function>
+void ThreadPool::push( TaskGroup* group, Function&& job ) {
+    WorkDeque* deque = ownDeque();
+    Task* task = reserveTask(deque);
+
+    if (!task) { // no deque to spare, or all its slots hold jobs not taken yet: the job runs right here instead
+        try { job(); }
+        catch (...) { keepException(group, std::current_exception()); }
+        return;
+    }
+
+    task->emplace(std::forward<Function>(job));
+    task->group = group;
+    if (group) group->jobsRemaining++;
+    pushTask(deque);
+}
+
+
+inline constexpr size_t WORK_PER_JOB = 1 << 14; // simple operations below which a job costs more than it saves
+
+// the fewest items worth a job of their own, when each item takes about workPerItem simple operations
+inline size_t grainFor( size_t workPerItem ) {
+    return std::max<size_t>(1, WORK_PER_JOB / std::max<size_t>(1, workPerItem));
+}
+
+// calls function(start, end) over consecutive chunks of [begin, end), at most one per thread and none smaller than
+// grain items, and waits for them. the calling thread does a chunk itself, so it can be called from inside jobs
+template <typename Function>
+void parallelFor( size_t begin, size_t end, size_t grain, Function&& function ) {
+    if (begin >= end) return;
+
+    const size_t count = end - begin;
+    const size_t chunks = std::clamp<size_t>(count / std::max<size_t>(1, grain), 1, ThreadPool::size());
+    const size_t chunkSize = (count + chunks - 1) / chunks;
+
+    if (chunkSize >= count) {
+        function(begin, end);
+        return;
+    }
+
+    TaskGroup group;
+    for (size_t start = begin + chunkSize; start < end; start += chunkSize) {
+        group.run([&function, start, chunkEnd = std::min(start + chunkSize, end)] { function(start, chunkEnd); });
+    }
+
+    std::exception_ptr thrownHere;
+    try { function(begin, begin + chunkSize); }
+    catch (...) { thrownHere = std::current_exception(); }
+
+    group.wait();
+    if (thrownHere) std::rethrow_exception(thrownHere);
+}
+
+// calls function(rowStart, rowEnd, colStart, colEnd) over a grid of tiles covering [0, rows) x [0, cols), cut in whole
+// multiples of rowStep and colStep, and waits for them. the grid is picked from the shape, so a short side doesn't
+// cap the parallelism: no more tiles than threads or than the work justifies (workPerCell operations per row and
+// column pair), then the smallest largest tile, then the squarest tiles, which touch the least data
+template <typename Function>
+void parallelFor2d( size_t rows, size_t cols, size_t rowStep, size_t colStep, size_t workPerCell, Function&& function ) {
+    if (rows == 0 or cols == 0) return;
+
+    auto ceilDiv = [] (size_t a, size_t b) { return (a + b - 1) / b; };
+    const size_t rowUnits = ceilDiv(rows, rowStep), colUnits = ceilDiv(cols, colStep);
+    const size_t maxTiles = std::clamp<size_t>(rows * cols * workPerCell / WORK_PER_JOB, 1, ThreadPool::size());
+
+    size_t tileRows = rows, tileCols = cols, tiles = 1;
+    for (size_t rowParts = 1; rowParts <= std::min(rowUnits, maxTiles); rowParts++) {
+        for (size_t colParts = 1; colParts <= std::min(colUnits, maxTiles / rowParts); colParts++) {
+            const size_t candidateRows = ceilDiv(rowUnits, rowParts) * rowStep, candidateCols = ceilDiv(colUnits, colParts) * colStep;
+            const size_t area = candidateRows * candidateCols, bestArea = tileRows * tileCols;
+            if (area < bestArea or (area == bestArea and candidateRows + candidateCols < tileRows + tileCols)) {
+                tileRows = candidateRows, tileCols = candidateCols, tiles = rowParts * colParts;
+            }
+        }
+    }
+
+    if (tiles == 1) {
+        function(0, rows, 0, cols);
+        return;
+    }
+
+    TaskGroup group;
+    for (size_t rowStart = 0; rowStart < rows; rowStart += tileRows) {
+        for (size_t colStart = 0; colStart < cols; colStart += tileCols) {
+            if (rowStart == 0 and colStart == 0) continue; // the calling thread's own
+            group.run([&function, rowStart, rowEnd = std::min(rowStart + tileRows, rows),
+                       colStart, colEnd = std::min(colStart + tileCols, cols)] { function(rowStart, rowEnd, colStart, colEnd); });
+        }
+    }
+
+    std::exception_ptr thrownHere;
+    try { function(0, std::min(tileRows, rows), 0, std::min(tileCols, cols)); }
+    catch (...) { thrownHere = std::current_exception(); }
+
+    group.wait();
+    if (thrownHere) std::rethrow_exception(thrownHere);
+}
+
+} // namespace mygrad
@@ -1,3 +1,7 @@
 #pragma once
 
-#define dtype double
\ No newline at end of file
+#ifdef MYGRAD_FLOAT32
+    #define dtype float
+#else
+    #define dtype double
+#endif
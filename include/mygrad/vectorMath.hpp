@@ -0,0 +1,135 @@
+#pragma once
+
+#include <bit>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include "types.hpp"
+
+namespace mygrad {
+
+// exp, log and sigmoid without calls into libm or branches, only arithmetic, selects and bit moves, so loops over
+// them are vectorized by the compiler (at -O3, like the gemm kernel, and with gcc's -fno-trapping-math, which the
+// library is built with) where std::exp keeps every element scalar.
+// accuracy, over the whole range including subnormal inputs to log and subnormal results of exp and sigmoid: exp
+// within 1 ulp of std::exp, log within 2 ulp of std::log for double and 3 ulp for float, sigmoid within 2 ulp. exp
+// goes to 0 and inf where std::exp does, and nan goes through all three. benchmarks/vectorMathCheck.cpp checks this.
+// one element at a time they're slower than libm's, which works from tables, so loops that stay scalar (a running
+// sum, a stride of 2) are better off with std::exp
+
+namespace vectorMath {
+
+template <typename T> struct Traits;
+
+template <> struct Traits<double> {
+    using Bits = uint64_t;
+    static constexpr int MANTISSA_BITS = 52, EXPONENT_BIAS = 1023;
+    static constexpr double EXP_MIN = -745.1332191019412, EXP_MAX = 709.782712893384; // e^x rounds to 0 and inf past them
+    static constexpr double SHIFTER = 0x1.8p52; // adding it rounds to an integer, left in the low bits
+    static constexpr double LN2_HIGH = 0x1.62e42fee00000p-1, LN2_LOW = 0x1.a39ef35793c76p-33;
+    static constexpr int EXP_TERMS = 13, LOG_TERMS = 11;
+};
+
+template <> struct Traits<float> {
+    using Bits = uint32_t;
+    static constexpr int MANTISSA_BITS = 23, EXPONENT_BIAS = 127;
+    static constexpr float EXP_MIN = -103.972077f, EXP_MAX = 88.7228317f;
+    static constexpr float SHIFTER = 0x1.8p23f;
+    static constexpr float LN2_HIGH = 0x1.62e400p-1f, LN2_LOW = 0x1.7f7d1cp-20f;
+    static constexpr int EXP_TERMS = 7, LOG_TERMS = 5;
+};
+
+// 1/k! for k = 0, ..., terms
+template <typename T, int terms>
+constexpr std::array<T, terms + 1> inverseFactorials() {
+    std::array<T, terms + 1> coefficients {};
+    double factorial = 1;
+    for (int k = 0; k <= terms; k++) {
+        factorial *= k ? k : 1;
+        coefficients[k] = static_cast<T>(1 / factorial);
+    }
+    return coefficients;
+}
+
+template <typename T>
+inline T exp( T x ) {
+    using Bits = typename Traits<T>::Bits;
+    using Tr = Traits<T>;
+
+    // x = n ln2 + r with |r| <= ln2 / 2, so e^x = 2^n e^r
+    const T clamped = x < Tr::EXP_MIN ? Tr::EXP_MIN : (x > Tr::EXP_MAX ? Tr::EXP_MAX : x);
+    const T shifted = clamped * T(1.4426950408889634) + Tr::SHIFTER;
+    const T n = shifted - Tr::SHIFTER;
+    const T r = (clamped - n * Tr::LN2_HIGH) - n * Tr::LN2_LOW;
+
+    // the taylor series of e^r, which is short enough on that interval
+    constexpr auto coefficients = inverseFactorials<T, Tr::EXP_TERMS>();
+    T polynomial = coefficients[Tr::EXP_TERMS];
+    for (int term = Tr::EXP_TERMS - 1; term >= 0; term--) polynomial = polynomial * r + coefficients[term];
+
+    // 2^n in two halves, each a normal number: n goes one past the largest exponent just under EXP_MAX, where e^r < 1
+    // brings the result back under the largest float, and down into the subnormal exponents near EXP_MIN. only the
+    // last product rounds, so subnormal results are as close as normal ones
+    using SignedBits = std::make_signed_t<Bits>;
+    const SignedBits exponent = static_cast<SignedBits>(std::bit_cast<Bits>(shifted) - std::bit_cast<Bits>(Tr::SHIFTER));
+    const SignedBits half = exponent >> 1;
+    const T twoToTheHalf = std::bit_cast<T>(static_cast<Bits>(half + Tr::EXPONENT_BIAS) << Tr::MANTISSA_BITS);
+    const T twoToTheRest = std::bit_cast<T>(static_cast<Bits>(exponent - half + Tr::EXPONENT_BIAS) << Tr::MANTISSA_BITS);
+
+    const T result = polynomial * twoToTheHalf * twoToTheRest;
+    return x != x ? x : (x < Tr::EXP_MIN ? T(0) : (x > Tr::EXP_MAX ? std::numeric_limits<T>::infinity() : result));
+}
+
+template <typename T>
+inline T log( T x ) {
+    using Bits = typename Traits<T>::Bits;
+    using Tr = Traits<T>;
+    constexpr Bits MANTISSA_MASK = (Bits(1) << Tr::MANTISSA_BITS) - 1;
+
+    // subnormals are scaled into the normal range first
+    const bool subnormal = x < std::numeric_limits<T>::min();
+    const T scaled = subnormal ? x * T(Bits(1) << Tr::MANTISSA_BITS) : x;
+    const Bits bits = std::bit_cast<Bits>(scaled);
+
+    // x = m 2^e with m in [sqrt(1/2), sqrt(2))
+    // the exponent goes through the shifter the other way round, an integer to float conversion would not vectorize
+    T e = std::bit_cast<T>((bits >> Tr::MANTISSA_BITS) | std::bit_cast<Bits>(Tr::SHIFTER)) - Tr::SHIFTER - Tr::EXPONENT_BIAS;
+    e = subnormal ? e - Tr::MANTISSA_BITS : e;
+    T m = std::bit_cast<T>((bits & MANTISSA_MASK) | (Bits(Tr::EXPONENT_BIAS) << Tr::MANTISSA_BITS));
+    const bool aboveSqrt2 = m > T(1.4142135623730951);
+    m = aboveSqrt2 ? m * T(0.5) : m;
+    e = aboveSqrt2 ? e + 1 : e;
+
+    // log m = 2 atanh(f) = 2 (f + f^3/3 + f^5/5 + ...) with f = (m - 1) / (m + 1), |f| < 0.172
+    const T f = (m - 1) / (m + 1), f2 = f * f;
+    T series = 0;
+    for (int term = Tr::LOG_TERMS - 1; term >= 0; term--) series = T(1) / T(2 * term + 1) + series * f2;
+    T result = e * Tr::LN2_HIGH + (e * Tr::LN2_LOW + 2 * f * series);
+
+    // one select after the other, nested they're turned into branches
+    const T infinity = std::numeric_limits<T>::infinity();
+    result = x == 0 ? -infinity : result;
+    result = x < 0 ? std::numeric_limits<T>::quiet_NaN() : result;
+    result = x == infinity ? infinity : result;
+    return x != x ? x : result;
+}
+
+// from e^-|x|, which can't overflow, so far negative x goes on into the subnormals as e^x / (1 + e^x) instead of 0
+template <typename T>
+inline T sigmoid( T x ) {
+    const T e = vectorMath::exp(x < 0 ? x : -x);
+    const T positive = 1 / (1 + e);
+    return x < 0 ? e * positive : positive;
+}
+
+} // namespace vectorMath
+
+
+// output[i] = f(input[i]) over whole arrays, split over the thread pool when they're long enough to be worth it.
+// output may be input
+void vectorExp( const dtype* input, dtype* output, size_t length );
+void vectorLog( const dtype* input, dtype* output, size_t length );
+void vectorSigmoid( const dtype* input, dtype* output, size_t length );
+
+} // namespace mygrad
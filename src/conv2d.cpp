@@ -1,16 +1,28 @@
+#include <algorithm>
+
 #include "mygrad/conv2d.hpp"
 #include "mygrad/helper.hpp"
+#include "mygrad/gemm.hpp"
 #include "mygrad/threadPool.hpp"
 
 namespace mygrad {
 
-Conv2d::Conv2d( size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride, size_t paddingSize ) : 
+Conv2d::Conv2d( size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride, size_t paddingSize, Activation activation ) : 
+        Conv2d(1, inChannels, outChannels, kernelSize, stride, paddingSize, activation) {}
+
+Conv2d::Conv2d( size_t upsamplingFactor, size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride, size_t paddingSize,
+                Activation activation ) : 
         inChannels(inChannels), outChannels(outChannels), kernelSize(kernelSize), stride(stride), paddingSize(paddingSize),
+        activation(activation),
         kernels( KaimingWeightsVector(kernelSize*kernelSize*inChannels, outChannels),
                  { outChannels, inChannels, kernelSize, kernelSize } ),
         biases( std::vector<dtype>(outChannels, 0), {outChannels} ),
+        upsamplingFactor(upsamplingFactor),
         matrixFormInput(Tensor::zeros({1})),
-        kernelMutexes(outChannels) {}
+        matrixFormOutput(Tensor::zeros({1})),
+        winogradKernels(Tensor::zeros({1})),
+        winogradInput(Tensor::zeros({1})),
+        winogradOutput(Tensor::zeros({1})) {}
 
 
 void Conv2d::print() {
@@ -18,68 +30,102 @@ void Conv2d::print() {
             << kernelSize << ", stride: " << stride << ", padding size: " << paddingSize << "\n";
 }
 
+size_t Conv2d::workspaceMemoryLimit = 32 << 20;
+
+
+UpsampleConv2d::UpsampleConv2d( size_t scalingFactor, size_t inChannels, size_t outChannels, size_t kernelSize, size_t stride, size_t paddingSize,
+                                Activation activation ) :
+        Conv2d(scalingFactor, inChannels, outChannels, kernelSize, stride, paddingSize, activation), scalingFactor(scalingFactor) {}
+
+void UpsampleConv2d::print() {
+    std::cout << "upsample (scaling factor " << scalingFactor << ") + ";
+    Conv2d::print();
+}
+
+
 void Conv2d::forward( Tensor& inputTensor ) {
 
     manageDimensions( inputTensor );
     setInputTensorPointer( &inputTensor );
 
-    im2col( inputTensor );
-    kernels.reshape( {outChannels, static_cast<size_t>(kernels.strides[0])} ); // the second term should be equal to matrixFormColumns
+    if (usesWinograd()) {
+        winogradForward( inputTensor );
+        return;
+    }
 
-    const size_t threads_n = ThreadPool::size();
-    const size_t chunkSize = std::ceil( (double) kernels.dimensions[0] / threads_n);
+    const size_t matrixFormRows = outputTensor.dimensions[0] * outputTensor.strides[1];
+    const size_t matrixFormColumns = kernelSize * kernelSize * inChannels;
+    const size_t chunkRows = matrixFormChunkRows();
 
-    for (size_t t=0; t < threads_n; t++) {
-        size_t startFilter = chunkSize * t, endFilter = std::min(startFilter+chunkSize, kernels.dimensions[0]); 
-        if (startFilter == endFilter) break;
-        ThreadPool::push(
-            [this, startFilter, endFilter] {
+    for (size_t firstRow = 0; firstRow < matrixFormRows; firstRow += chunkRows) {
+        const size_t rows = std::min(chunkRows, matrixFormRows - firstRow);
 
-                for (size_t filterRow=startFilter; filterRow < endFilter; filterRow++) {
-                    for (size_t inputRow=0; inputRow < matrixFormInput.dimensions[0]; inputRow++) {
+        im2col( inputTensor, firstRow, rows );
 
-                        const size_t inputImage = inputRow / outputTensor.strides[1];
-                        const size_t outputRow = (inputRow % outputTensor.strides[1]) / outputTensor.strides[2];
-                        const size_t outputCol = inputRow % outputTensor.strides[2];
+        // matrix form output = activation(matrix form input * kernels^T + biases)
+        gemm( Transpose::No, Transpose::Yes, rows, outChannels, matrixFormColumns,
+              matrixFormInput.data.get(), matrixFormColumns,
+              kernels.data.get(), matrixFormColumns,
+              matrixFormOutput.data.get(), outChannels,
+              false, biases.data.get(), activation );
 
-                        outputTensor.at({inputImage, filterRow, outputRow, outputCol}) = std::transform_reduce( 
-                            &matrixFormInput.data[inputRow * matrixFormInput.dimensions[1]], 
-                            &matrixFormInput.data[(inputRow + 1) * matrixFormInput.dimensions[1]],
-                            &kernels.at({filterRow, 0}),
-                            biases.at({filterRow})
-                        ); // dot product
-                    }
-                }
-            }
-        );
+        matrixFormToOutput( firstRow, rows );
     }
+}
+
+
+size_t Conv2d::matrixFormChunkRows() {
+
+    // the matrix forms are processed in chunks of rows that, together with their grads, fit into workspaceMemoryLimit,
+    // so memory use doesn't grow with the batch size. in inference mode there are no grads, so the chunks are twice
+    // as long. the buffers are only reallocated when the chunk size changes
+
+    const size_t matrixFormRows = outputTensor.dimensions[0] * outputTensor.strides[1];
+    const size_t matrixFormColumns = kernelSize * kernelSize * inChannels;
+    const size_t bytesPerRow = (GradMode::enabled() ? 2 : 1) * (matrixFormColumns + outChannels) * sizeof(dtype);
+    const size_t chunkRows = std::clamp<size_t>(workspaceMemoryLimit / bytesPerRow, 1, matrixFormRows);
 
-    ThreadPool::waitUntilDone();
+    TensorDims neededInputDims = {chunkRows, matrixFormColumns}, neededOutputDims = {chunkRows, outChannels};
+    if (!matrixFormInput.fits(neededInputDims)) matrixFormInput = Tensor::zeros( neededInputDims );
+    if (!matrixFormOutput.fits(neededOutputDims)) matrixFormOutput = Tensor::zeros( neededOutputDims );
 
-    kernels.reshape( {outChannels, inChannels, kernelSize, kernelSize});
+    return chunkRows;
 }
 
 
-void Conv2d::movePatchToMatrixForm( size_t picture, int leftUpperRow, int leftUpperCol, Tensor& matrixFormInput, size_t rowInMatrixForm ) {
+Conv2d::SourceOffsets Conv2d::sourceOffsets( const Tensor& inputTensor, size_t rowsTouched, size_t colsTouched ) const {
 
-    // ASSUMES MATRIXFORMTENSOR IS FILLED WITH ZEROS
+    const int factor = upsamplingFactor, inputCols = inputTensor.dimensions[3];
+    const int upsampledRows = inputTensor.dimensions[2] * factor, upsampledCols = inputCols * factor;
+
+    SourceOffsets offsets { std::vector<int>(rowsTouched), std::vector<int>(colsTouched) };
+    for (size_t i = 0; i < rowsTouched; i++) {
+        const int row = static_cast<int>(i) - static_cast<int>(paddingSize);
+        offsets.rows[i] = (row >= 0 and row < upsampledRows) ? (row / factor) * inputCols : -1;
+    }
+    for (size_t i = 0; i < colsTouched; i++) {
+        const int col = static_cast<int>(i) - static_cast<int>(paddingSize);
+        offsets.cols[i] = (col >= 0 and col < upsampledCols) ? col / factor : -1;
+    }
+    return offsets;
+}
+
+
+void Conv2d::movePatchToMatrixForm( size_t picture, size_t patchTop, size_t patchLeft, const SourceOffsets& offsets, size_t rowInMatrixForm ) {
 
     const Tensor& inputTensor = *currentInputTensor;
-    const size_t inpLoc = picture * inputTensor.strides[0] + leftUpperRow * inputTensor.strides[2] + leftUpperCol;
 
     size_t matrixFormLoc = rowInMatrixForm * matrixFormInput.strides[0];
 
     for (size_t inputChannel = 0; inputChannel < inChannels; inputChannel++) {
-        size_t inpLocAtChannel = inpLoc + inputChannel * inputTensor.strides[1];
+        const dtype* channelData = &inputTensor.data[picture * inputTensor.strides[0] + inputChannel * inputTensor.strides[1]];
         for (size_t patchRow = 0; patchRow < kernelSize; patchRow++) {
+            const int rowOffset = offsets.rows[patchTop + patchRow];
             for (size_t patchCol = 0; patchCol < kernelSize; patchCol++) {
+                const int colOffset = offsets.cols[patchLeft + patchCol];
 
-                if (! (leftUpperRow + patchRow < 0 or leftUpperCol + patchCol < 0 or 
-                    leftUpperRow + patchRow >= inputTensor.dimensions[2] or
-                    leftUpperCol + patchCol >= inputTensor.dimensions[3])) {
-
-                        matrixFormInput.data[matrixFormLoc] = inputTensor.data[inpLocAtChannel + patchRow * inputTensor.strides[2] + patchCol];
-                }
+                // padding is written out explicitly, so the buffer never has to be cleared
+                matrixFormInput.data[matrixFormLoc] = (rowOffset >= 0 and colOffset >= 0) ? channelData[rowOffset + colOffset] : 0;
                 matrixFormLoc++;
             }
         }
@@ -87,121 +133,203 @@ void Conv2d::movePatchToMatrixForm( size_t picture, int leftUpperRow, int leftUp
 }
 
 
-void Conv2d::im2col( const Tensor& inputTensor ) {
+void Conv2d::im2col( const Tensor& inputTensor, size_t firstRow, size_t rows ) {
 
-    const size_t matrixFormColumns = kernelSize * kernelSize * inChannels;
-    const size_t matrixFormRowsForSinglePicture = convolvedSize(inputTensor.dimensions[2]) * convolvedSize(inputTensor.dimensions[3]); 
-    TensorDims neededMatrixFormDims = {matrixFormRowsForSinglePicture * inputTensor.dimensions[0], matrixFormColumns};
+    // rows [firstRow, firstRow + rows) of the matrix form of the whole batch go to the rows of matrixFormInput
+    const size_t outputPixels = outputTensor.strides[1], outputCols = outputTensor.dimensions[3];
+    const SourceOffsets offsets = sourceOffsets( inputTensor, (outputTensor.dimensions[2] - 1) * stride + kernelSize,
+                                                 (outputCols - 1) * stride + kernelSize );
 
-    if (matrixFormInput.dimensions != neededMatrixFormDims) {
-        matrixFormInput = Tensor::zeros( neededMatrixFormDims );
-    } 
-    else { std::fill(matrixFormInput.data.get(), matrixFormInput.data.get() + matrixFormInput.length, 0 ); } // instead of reassignment to avoid an unnecessary memory allocation
+    parallelFor(0, rows, grainFor(matrixFormInput.strides[0]), [this, &offsets, firstRow, outputPixels, outputCols] (size_t startRow, size_t endRow) {
+        for (size_t row = startRow; row < endRow; row++) {
+            const size_t picture = (firstRow + row) / outputPixels, pixel = (firstRow + row) % outputPixels;
 
+            movePatchToMatrixForm(picture, (pixel / outputCols) * stride, (pixel % outputCols) * stride, offsets, row);
+        }
+    });
+}
 
-    const size_t threads_n = ThreadPool::size();
-    const size_t chunkSize = std::ceil( (double) inputTensor.dimensions[0] / threads_n);
 
-    for (size_t t=0; t < threads_n; t++) {
-        size_t startPicture = chunkSize * t, endPicture = std::min(startPicture+chunkSize, outputTensor.dimensions[0]); 
-        ThreadPool::push([this, &inputTensor, matrixFormRowsForSinglePicture, startPicture, endPicture] {
+void Conv2d::matrixFormToOutput( size_t firstRow, size_t rows ) {
 
-            size_t rowInMatrixForm = startPicture * matrixFormRowsForSinglePicture;
+    // the matrix form output is laid out as [picture and pixel, channel], the output as [picture, channel, pixel]
+    const size_t outputPixels = outputTensor.strides[1];
 
-            for (size_t picture = startPicture; picture < endPicture; picture++) {
-                for (int row = -static_cast<int>(paddingSize) ; row < static_cast<int>(inputTensor.dimensions[2] + paddingSize - kernelSize + 1); row += stride) {
+    parallelFor(0, rows, grainFor(outChannels), [this, firstRow, outputPixels] (size_t startRow, size_t endRow) {
+        for (size_t row = startRow; row < endRow; row++) {
+            const size_t picture = (firstRow + row) / outputPixels, pixel = (firstRow + row) % outputPixels;
+            dtype* pictureData = &outputTensor.data[picture * outputTensor.strides[0] + pixel];
+            const dtype* matrixFormRow = &matrixFormOutput.data[row * outChannels];
 
-                    for (int column = -static_cast<int>(paddingSize); column < static_cast<int>(inputTensor.dimensions[3] + paddingSize - kernelSize + 1); column += stride) {
-                    
-                        movePatchToMatrixForm(picture, row, column, matrixFormInput, rowInMatrixForm);
-                        rowInMatrixForm++;
-                    }
-                }
+            for (size_t channel = 0; channel < outChannels; channel++) {
+                pictureData[channel * outputPixels] = matrixFormRow[channel];
             }
-        });
-    }
+        }
+    });
+}
+
+
+void Conv2d::outputGradsToMatrixForm( size_t firstRow, size_t rows ) {
+
+    // the reverse of matrixFormToOutput, for the grads
+    const size_t outputPixels = outputTensor.strides[1];
 
-    ThreadPool::waitUntilDone();
+    parallelFor(0, rows, grainFor(outChannels), [this, firstRow, outputPixels] (size_t startRow, size_t endRow) {
+        for (size_t row = startRow; row < endRow; row++) {
+            const size_t picture = (firstRow + row) / outputPixels, pixel = (firstRow + row) % outputPixels;
+            const dtype* pictureGrads = &outputTensor.grads[picture * outputTensor.strides[0] + pixel];
+            dtype* matrixFormRow = &matrixFormOutput.grads[row * outChannels];
+
+            for (size_t channel = 0; channel < outChannels; channel++) {
+                matrixFormRow[channel] = pictureGrads[channel * outputPixels];
+            }
+        }
+    });
 }
 
 
-void Conv2d::convolveBackward(size_t pictureIndex, size_t outChannel, int inputRow, int inputCol, dtype gradPassedDown) {
-    std::lock_guard lock(kernelMutexes[outChannel]);
+void Conv2d::movePatchGradsFromMatrixForm( size_t picture, size_t inputChannel, size_t patchTop, size_t patchLeft, 
+                                           const SourceOffsets& offsets, size_t rowInMatrixForm ) {
 
-    biases.gradAt( {outChannel} ) += gradPassedDown;
-    Tensor& input = *currentInputTensor;
-    const size_t almostInpLoc = pictureIndex * input.strides[0] + inputRow * input.strides[2] + inputCol * input.strides[3];
+    // the reverse of movePatchToMatrixForm for a single input channel: adds the grads of the patch back onto the pixels it was taken from
 
-    for (size_t inputChannel = 0; inputChannel < inChannels; inputChannel++) {
-        const size_t leftUpperCornerInpLoc = almostInpLoc + inputChannel * input.strides[1];
-        for (size_t kernelRow = 0; kernelRow < kernelSize; kernelRow++) {
-            for (size_t kernelCol = 0; kernelCol < kernelSize; kernelCol++) {
-
-                if (inputRow + kernelRow < 0 or inputCol + kernelCol < 0 or 
-                    inputRow + kernelRow >= currentInputTensor->dimensions[2] or
-                    inputCol + kernelCol >= currentInputTensor->dimensions[3]) {
-                    continue;
-                }
+    Tensor& inputTensor = *currentInputTensor;
+
+    dtype* channelGrads = &inputTensor.grads[picture * inputTensor.strides[0] + inputChannel * inputTensor.strides[1]];
+    size_t matrixFormLoc = rowInMatrixForm * matrixFormInput.strides[0] + inputChannel * kernelSize * kernelSize;
 
-                const size_t inpLoc = leftUpperCornerInpLoc + kernelRow * input.strides[2] + kernelCol;
-                const size_t kernelLoc = outChannel * kernels.strides[0] + inputChannel * kernels.strides[1] + 
-                                         kernelRow  * kernels.strides[2] + kernelCol;
+    for (size_t patchRow = 0; patchRow < kernelSize; patchRow++) {
+        const int rowOffset = offsets.rows[patchTop + patchRow];
+        for (size_t patchCol = 0; patchCol < kernelSize; patchCol++) {
+            const int colOffset = offsets.cols[patchLeft + patchCol];
 
-                input.grads[inpLoc] += kernels.data[kernelLoc] * gradPassedDown;
-                kernels.grads[kernelLoc] += input.data[inpLoc] * gradPassedDown;
+            if (rowOffset >= 0 and colOffset >= 0) {
+                channelGrads[rowOffset + colOffset] += matrixFormInput.grads[matrixFormLoc];
             }
+            matrixFormLoc++;
         }
     }
 }
 
+
+void Conv2d::col2im( Tensor& inputTensor, size_t firstRow, size_t rows ) {
+
+    // patches overlap, so the work is split by (picture, input channel) planes of the input grads, 
+    // each of which only ever has one writer and needs no locks
+    const size_t outputPixels = outputTensor.strides[1], outputCols = outputTensor.dimensions[3];
+    const size_t firstPicture = firstRow / outputPixels, lastPicture = (firstRow + rows - 1) / outputPixels;
+    const size_t planes = (lastPicture - firstPicture + 1) * inChannels;
+    const SourceOffsets offsets = sourceOffsets( inputTensor, (outputTensor.dimensions[2] - 1) * stride + kernelSize,
+                                                 (outputCols - 1) * stride + kernelSize );
+
+    const size_t grain = grainFor(std::min(rows, outputPixels) * kernelSize * kernelSize);
+    parallelFor(0, planes, grain, [this, &offsets, firstRow, rows, outputPixels, outputCols, firstPicture] (size_t startPlane, size_t endPlane) {
+        for (size_t plane = startPlane; plane < endPlane; plane++) {
+            const size_t picture = firstPicture + plane / inChannels, inputChannel = plane % inChannels;
+            const size_t startRow = std::max(firstRow, picture * outputPixels);
+            const size_t endRow = std::min(firstRow + rows, (picture + 1) * outputPixels);
+
+            for (size_t row = startRow; row < endRow; row++) {
+                const size_t pixel = row - picture * outputPixels;
+
+                movePatchGradsFromMatrixForm(picture, inputChannel, (pixel / outputCols) * stride, (pixel % outputCols) * stride,
+                                             offsets, row - firstRow);
+            }
+        }
+    });
+}
+
+
 void Conv2d::backward() {
     #ifndef NDEBUG
         if (!(currentInputTensor)) throw std::runtime_error("backward before forward impossible");
     #endif
 
     Tensor& inputTensor = *currentInputTensor;
-    const size_t threads_n = ThreadPool::size();
-    const size_t chunkSize = std::ceil( (double) inputTensor.dimensions[0] / threads_n);
-
-    for (size_t t=0; t < threads_n; t++) {
-        size_t startPicture = chunkSize * t, endPicture = std::min(startPicture+chunkSize, outputTensor.dimensions[0]); 
-        if (startPicture == endPicture) break;
-        ThreadPool::push([this, &inputTensor, startPicture, endPicture] {
-
-            size_t locInOutput = startPicture * outputTensor.strides[0];
-
-            for (size_t picture = startPicture; picture < endPicture; picture++) {
-                for (size_t channelOut = 0; channelOut < outChannels; channelOut++) {
-                    for (int row = -static_cast<int>(paddingSize); row < static_cast<int>(inputTensor.dimensions[2] + paddingSize - kernelSize + 1); row += stride) {
-
-                        for (int column = -static_cast<int>(paddingSize); column < static_cast<int>(inputTensor.dimensions[3] + paddingSize - kernelSize + 1); column += stride) {
-                        
-                            dtype gradPassedDown = outputTensor.grads[locInOutput];
-                            convolveBackward(picture, channelOut, row, column, gradPassedDown);
-                            locInOutput++;
-                        }
-                    }
+
+    activationAndBiasGrads();
+
+    if (usesWinograd()) {
+        winogradBackward( inputTensor );
+    }
+    else {
+        const size_t matrixFormRows = outputTensor.dimensions[0] * outputTensor.strides[1];
+        const size_t matrixFormColumns = kernelSize * kernelSize * inChannels;
+        const size_t chunkRows = matrixFormInput.dimensions[0];
+
+        for (size_t firstRow = 0; firstRow < matrixFormRows; firstRow += chunkRows) {
+            const size_t rows = std::min(chunkRows, matrixFormRows - firstRow);
+
+            // with a single chunk the matrix form input is still there from forward
+            if (chunkRows < matrixFormRows) im2col( inputTensor, firstRow, rows );
+
+            outputGradsToMatrixForm( firstRow, rows );
+
+            // kernel grads += matrix form output grads^T * matrix form input
+            gemm( Transpose::Yes, Transpose::No, outChannels, matrixFormColumns, rows,
+                  matrixFormOutput.grads.get(), outChannels,
+                  matrixFormInput.data.get(), matrixFormColumns,
+                  kernels.grads.get(), matrixFormColumns,
+                  true );
+
+            // matrix form input grads = matrix form output grads * kernels, scattered back onto the input by col2im
+            gemm( Transpose::No, Transpose::No, rows, matrixFormColumns, outChannels,
+                  matrixFormOutput.grads.get(), outChannels,
+                  kernels.data.get(), matrixFormColumns,
+                  matrixFormInput.grads.get(), matrixFormColumns,
+                  false );
+
+            col2im( inputTensor, firstRow, rows );
+        }
+    }
+
+    setInputTensorPointer(nullptr);
+}
+
+
+void Conv2d::activationAndBiasGrads() {
+
+    // turns the output grads into grads of the pre-activation output in place, and sums them up for the bias grads
+
+    const size_t pictures = outputTensor.dimensions[0], outputPixels = outputTensor.strides[1];
+    parallelFor(0, outChannels, grainFor(pictures * outputPixels), [this, pictures, outputPixels] (size_t startChannel, size_t endChannel) {
+        for (size_t channel = startChannel; channel < endChannel; channel++) {
+            dtype channelGradSum = 0;
+            for (size_t picture = 0; picture < pictures; picture++) {
+                const size_t channelStart = picture * outputTensor.strides[0] + channel * outputPixels;
+                dtype* channelGrads = &outputTensor.grads[channelStart];
+                const dtype* channelData = &outputTensor.data[channelStart];
+                for (size_t pixel = 0; pixel < outputPixels; pixel++) {
+                    if (activation != Activation::None) channelGrads[pixel] *= activationDerivative(activation, channelData[pixel]);
+                    channelGradSum += channelGrads[pixel];
                 }
             }
-        });
-    }
+            biases.grads[channel] += channelGradSum;
+        }
+    });
+}
 
-    ThreadPool::waitUntilDone();
 
-    setInputTensorPointer(nullptr);
+PassCost Conv2d::forwardCost() const {
+    if (!currentInputTensor) return {};
+    return { 2.0 * outputTensor.length * inChannels * kernelSize * kernelSize,
+             static_cast<double>((currentInputTensor->length + kernels.length + biases.length + outputTensor.length) * sizeof(dtype)) };
+}
+
+PassCost Conv2d::backwardCost() const {
+    // the input grads and the kernel grads each take as much as the forward pass
+    const PassCost forward = forwardCost();
+    return { 2 * forward.flops, 2 * forward.bytes };
 }
 
 
-void Conv2d::manageDimensions( const Tensor& inputTensor ) {
-    if (inputTensor.dimensions.size() != 4) throw std::runtime_error("input tensor dimensionality must be four for Conv2d");
+TensorDims Conv2d::outputDimensions( const TensorDims& inputDimensions ) const {
+    if (inputDimensions.size() != 4) throw std::runtime_error("input tensor dimensionality must be four for Conv2d");
 
-    TensorDims neededOutTensorDims = { inputTensor.dimensions[0],
-                                       outChannels,
-                                       convolvedSize(inputTensor.dimensions[2]),
-                                       convolvedSize(inputTensor.dimensions[3]) };
-    if (outputTensor.dimensions != neededOutTensorDims) {
-        adjustOutTensorDimensions(neededOutTensorDims);
-    }
+    return { inputDimensions[0],
+             outChannels,
+             convolvedSize(inputDimensions[2] * upsamplingFactor),
+             convolvedSize(inputDimensions[3] * upsamplingFactor) };
 }
 
 } // namespace mygrad
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "mygrad/gemm.hpp"
+#include "mygrad/threadPool.hpp"
+
+namespace mygrad {
+
+// register block: the micro-kernel keeps an MR x NR tile of C in registers
+static constexpr size_t MR = 4;
+static constexpr size_t NR = 64 / sizeof(dtype); // one cache line of packed B per step
+// cache blocks: a packed MC x KC block of A is meant to stay in L2, a KC x NC panel of B in L3
+static constexpr size_t MC = 64;
+static constexpr size_t KC = 256;
+static constexpr size_t NC = 2048;
+
+struct GemmArguments {
+    Transpose transA, transB;
+    size_t M, N, K;
+    const dtype* A; size_t lda;
+    const dtype* B; size_t ldb;
+    dtype* C; size_t ldc;
+    bool accumulate;
+    const dtype* bias;
+    Activation activation;
+};
+
+static inline size_t ceilDiv( size_t a, size_t b ) { return (a + b - 1) / b; }
+
+static inline dtype elementOf( const dtype* matrix, size_t ld, Transpose transpose, size_t row, size_t col ) {
+    return transpose == Transpose::No ? matrix[row * ld + col] : matrix[col * ld + row];
+}
+
+
+static void packA( const GemmArguments& args, size_t firstRow, size_t rows, size_t firstDepth, size_t depth, dtype* packed ) {
+    // slivers of MR rows of op(A), each laid out column after column and padded with zeros,
+    // so the micro-kernel reads them strictly sequentially
+    for (size_t sliverRow = 0; sliverRow < rows; sliverRow += MR) {
+        const size_t sliverRows = std::min(MR, rows - sliverRow);
+        for (size_t p = 0; p < depth; p++) {
+            for (size_t i = 0; i < sliverRows; i++) {
+                packed[p * MR + i] = elementOf(args.A, args.lda, args.transA, firstRow + sliverRow + i, firstDepth + p);
+            }
+            for (size_t i = sliverRows; i < MR; i++) {
+                packed[p * MR + i] = 0;
+            }
+        }
+        packed += depth * MR;
+    }
+}
+
+static void packB( const GemmArguments& args, size_t firstDepth, size_t depth, size_t firstCol, size_t cols, dtype* packed ) {
+    // slivers of NR columns of op(B), each laid out row after row and padded with zeros
+    for (size_t sliverCol = 0; sliverCol < cols; sliverCol += NR) {
+        const size_t sliverCols = std::min(NR, cols - sliverCol);
+        for (size_t p = 0; p < depth; p++) {
+            for (size_t j = 0; j < sliverCols; j++) {
+                packed[p * NR + j] = elementOf(args.B, args.ldb, args.transB, firstDepth + p, firstCol + sliverCol + j);
+            }
+            for (size_t j = sliverCols; j < NR; j++) {
+                packed[p * NR + j] = 0;
+            }
+        }
+        packed += depth * NR;
+    }
+}
+
+
+static inline void microKernel( size_t depth, const dtype* __restrict a, const dtype* __restrict b, dtype (&tile)[MR][NR] ) {
+    for (size_t p = 0; p < depth; p++) {
+        for (size_t i = 0; i < MR; i++) {
+            for (size_t j = 0; j < NR; j++) {
+                tile[i][j] += a[i] * b[j];
+            }
+        }
+        a += MR, b += NR;
+    }
+}
+
+static inline void storeTile( const GemmArguments& args, const dtype (&tile)[MR][NR],
+                              size_t row, size_t rows, size_t col, size_t cols, bool firstDepthBlock, bool lastDepthBlock ) {
+    const bool overwrite = firstDepthBlock and not args.accumulate;
+    const bool applyActivation = lastDepthBlock and args.activation != Activation::None;
+    for (size_t i = 0; i < rows; i++) {
+        dtype* cRow = args.C + (row + i) * args.ldc + col;
+        for (size_t j = 0; j < cols; j++) {
+            dtype value = tile[i][j];
+            if (firstDepthBlock and args.bias) value += args.bias[col + j];
+            value = overwrite ? value : cRow[j] + value;
+            cRow[j] = applyActivation ? activate(args.activation, value) : value;
+        }
+    }
+}
+
+
+static void multiplyBlock( const GemmArguments& args, size_t rowStart, size_t rowEnd, size_t colStart, size_t colEnd ) {
+    thread_local std::vector<dtype> packedA, packedB;
+
+    for (size_t colBlock = colStart; colBlock < colEnd; colBlock += NC) {
+        const size_t cols = std::min(NC, colEnd - colBlock);
+
+        for (size_t depthBlock = 0; depthBlock < args.K; depthBlock += KC) {
+            const size_t depth = std::min(KC, args.K - depthBlock);
+
+            packedB.resize(ceilDiv(cols, NR) * NR * depth);
+            packB(args, depthBlock, depth, colBlock, cols, packedB.data());
+
+            for (size_t rowBlock = rowStart; rowBlock < rowEnd; rowBlock += MC) {
+                const size_t rows = std::min(MC, rowEnd - rowBlock);
+
+                packedA.resize(ceilDiv(rows, MR) * MR * depth);
+                packA(args, rowBlock, rows, depthBlock, depth, packedA.data());
+
+                for (size_t sliverCol = 0; sliverCol < cols; sliverCol += NR) {
+                    for (size_t sliverRow = 0; sliverRow < rows; sliverRow += MR) {
+                        dtype tile[MR][NR] = {};
+                        microKernel(depth, &packedA[sliverRow * depth], &packedB[sliverCol * depth], tile);
+                        storeTile(args, tile,
+                                  rowBlock + sliverRow, std::min(MR, rows - sliverRow),
+                                  colBlock + sliverCol, std::min(NR, cols - sliverCol),
+                                  depthBlock == 0, depthBlock + depth == args.K);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void gemm( Transpose transA, Transpose transB,
+           size_t M, size_t N, size_t K,
+           const dtype* A, size_t lda,
+           const dtype* B, size_t ldb,
+           dtype* C, size_t ldc,
+           bool accumulate, const dtype* bias, Activation activation ) {
+
+    if (M == 0 or N == 0) return;
+
+    if (K == 0) { // nothing to multiply, C is just the bias
+        if (accumulate and not bias and activation == Activation::None) return;
+        for (size_t row = 0; row < M; row++) {
+            for (size_t col = 0; col < N; col++) {
+                const dtype biasValue = bias ? bias[col] : 0;
+                C[row * ldc + col] = activate(activation, accumulate ? C[row * ldc + col] + biasValue : biasValue);
+            }
+        }
+        return;
+    }
+
+    const GemmArguments args { transA, transB, M, N, K, A, lda, B, ldb, C, ldc, accumulate, bias, activation };
+
+    // every job gets a rectangle of C of its own, so no two jobs ever write to the same element.
+    // rows are cut in whole register slivers, columns likewise, and the grid follows the shape of C:
+    // a single row (batch size 1) is split by columns, a handful of output channels by pixels
+    parallelFor2d(M, N, MR, NR, K, [&args] (size_t rowStart, size_t rowEnd, size_t colStart, size_t colEnd) {
+        multiplyBlock(args, rowStart, rowEnd, colStart, colEnd);
+    });
+}
+
+} // namespace mygrad
@@ -7,19 +7,26 @@
 
 #include "mygrad/helper.hpp"
 #include "mygrad/types.hpp"
+#include "mygrad/random.hpp"
 
 namespace mygrad { 
 
 static std::random_device dev;
 static std::mt19937 generator(dev());
+static Philox weightGenerator(randomSeed());
+
+void setSeed(uint64_t seed) {
+    generator.seed(static_cast<std::mt19937::result_type>(seed));
+    weightGenerator.seed(seed);
+}
+
+uint64_t layerSeed() {
+    return weightGenerator.bits();
+}
 
 std::vector<dtype> normDistVector(size_t length, dtype standardDeviation) {
-    std::normal_distribution<dtype> normDist{0, standardDeviation};
     std::vector<dtype> v(length);
-    for (size_t i = 0; i < length; i++) {
-        v[i] = normDist(generator);
-    }
-
+    weightGenerator.normal(v.data(), length, 0, standardDeviation);
     return v;
 }
 
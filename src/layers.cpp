@@ -8,6 +8,7 @@
 
 #include "mygrad/layers.hpp"
 #include "mygrad/threadPool.hpp"
+#include "mygrad/vectorMath.hpp"
 
 namespace mygrad {
 
@@ -25,6 +26,24 @@ void Layer::adjustOutTensorDimensions( const TensorDims& newDimensions ) {
     outputTensor = Tensor::zeros( newDimensions );
 }
 
+void Layer::manageDimensions( const Tensor& inputTensor ) {
+    const TensorDims neededOutDims = outputDimensions( inputTensor.dimensions );
+    if (!outputTensor.fits(neededOutDims)) adjustOutTensorDimensions(neededOutDims);
+}
+
+PassCost Layer::forwardCost() const {
+    if (!currentInputTensor) return {};
+    return { static_cast<double>(outputTensor.length),
+             static_cast<double>((currentInputTensor->length + outputTensor.length) * sizeof(dtype)) };
+}
+
+PassCost Layer::backwardCost() const {
+    if (!currentInputTensor) return {};
+    // reads the input and the output grads, adds to the input grads
+    return { static_cast<double>(currentInputTensor->length),
+             static_cast<double>((2*currentInputTensor->length + outputTensor.length) * sizeof(dtype)) };
+}
+
 void Layer::zeroGrad() {
     for (Tensor* t : parameterTensors()) {
         t->zeroGrad();
@@ -43,38 +62,23 @@ void ReLU::forward( Tensor& inputTensor ) {
     }
 }
 
-void ReLU::manageDimensions( const Tensor& inputTensor ) {
-    if (inputTensor.dimensions != outputTensor.dimensions ) {
-        adjustOutTensorDimensions(inputTensor.dimensions);
-    } 
-}
-
 void ReLU::backward() {
     #ifndef NDEBUG
         if (!(currentInputTensor)) throw std::runtime_error("backward before forward impossible");
     #endif
 
     for (size_t i = 0; i < currentInputTensor->length; i++) {
-        currentInputTensor->grads[i] += (currentInputTensor->data[i] >= 0 ? outputTensor.grads[i] : 0);
+        currentInputTensor->grads[i] += (currentInputTensor->data[i] > 0 ? outputTensor.grads[i] : 0);
     }
 
     setInputTensorPointer(nullptr);
 }
 
-void Sigmoid::manageDimensions( const Tensor& inputTensor ) {
-    if (inputTensor.dimensions != outputTensor.dimensions ) {
-        adjustOutTensorDimensions(inputTensor.dimensions);
-    } 
-}
-
-
 void Sigmoid::forward( Tensor& inputTensor ) {
     manageDimensions( inputTensor );
     setInputTensorPointer( &inputTensor );
 
-    for (size_t i = 0; i < inputTensor.length; i++) {
-        outputTensor.data[i] = 1 / (1 + std::exp( -inputTensor.data[i]) );
-    }
+    vectorSigmoid(inputTensor.data.get(), outputTensor.data.get(), inputTensor.length);
 }
 
 void Sigmoid::backward() {
@@ -84,26 +88,28 @@ void Sigmoid::backward() {
 
     Tensor& inputTensor = *currentInputTensor;
 
-    for (size_t i = 0; i < inputTensor.length; i++) {
-        dtype negexp = std::exp(-inputTensor.data[i]);
-        inputTensor.grads[i] += (negexp / ((1 + negexp) * (1 + negexp)) ) * outputTensor.grads[i];
-    }
+    // sigmoid' = y (1 - y) from the output kept by forward, instead of another exp per element
+    const dtype* output = outputTensor.data.get();
+    parallelFor(0, inputTensor.length, grainFor(4), [&] (size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) {
+            inputTensor.grads[i] += output[i] * (1 - output[i]) * outputTensor.grads[i];
+        }
+    });
 
     setInputTensorPointer(nullptr);
 }
 
 
-void Upsample::manageDimensions( const Tensor& inputTensor ) {
+TensorDims Upsample::outputDimensions( const TensorDims& inputDimensions ) const {
 
-    if (inputTensor.dimensions.size() != 4) {
-        std::cerr << inputTensor.dimensions;
+    if (inputDimensions.size() != 4) {
+        std::cerr << inputDimensions;
         throw std::runtime_error("Upsample expects a 4d tensor, dimensions received are printed above");
     }
 
-    TensorDims neededOutDims = inputTensor.dimensions;
+    TensorDims neededOutDims = inputDimensions;
     neededOutDims[2] *= scalingFactor, neededOutDims[3] *= scalingFactor; 
-
-    if (outputTensor.dimensions != neededOutDims) adjustOutTensorDimensions(neededOutDims);
+    return neededOutDims;
 }
 
 
@@ -172,24 +178,28 @@ void Reshape::backward() {
     setInputTensorPointer(nullptr);
 }
 
-void Reshape::manageDimensions( const Tensor& inputTensor ) {
-    if (inputTensor.length != outputTensor.length) {
-        if (freeDimension.has_value()) {
-            size_t outLengthWithoutFreeDim = 1;
-            for (size_t i = 0; i < newDimensions.size(); i++) {
-                if (i != freeDimension) {
-                    outLengthWithoutFreeDim *= newDimensions[i];
-                }
-            }
-            if (inputTensor.length % outLengthWithoutFreeDim != 0) throw std::runtime_error("dimensions for reshape with free dimension are invalid");
-
-            newDimensions[freeDimension.value()] = inputTensor.length / outLengthWithoutFreeDim;
+TensorDims Reshape::outputDimensions( const TensorDims& inputDimensions ) const {
+    const size_t inputLength = Tensor::lengthFromDimensions(inputDimensions);
+    if (inputLength == Tensor::lengthFromDimensions(newDimensions)) return newDimensions;
 
-            outputTensor = Tensor::zeros(newDimensions);
-        }   
+    if (!freeDimension.has_value()) throw std::runtime_error("reshape can't be done when the length of the input and the output are different");
 
-        else throw std::runtime_error("reshape can't be done when the length of the input and the output are different");
+    size_t outLengthWithoutFreeDim = 1;
+    for (size_t i = 0; i < newDimensions.size(); i++) {
+        if (i != freeDimension) {
+            outLengthWithoutFreeDim *= newDimensions[i];
+        }
     }
+    if (inputLength % outLengthWithoutFreeDim != 0) throw std::runtime_error("dimensions for reshape with free dimension are invalid");
+
+    TensorDims neededOutDims = newDimensions;
+    neededOutDims[freeDimension.value()] = inputLength / outLengthWithoutFreeDim;
+    return neededOutDims;
+}
+
+void Reshape::manageDimensions( const Tensor& inputTensor ) {
+    newDimensions = outputDimensions( inputTensor.dimensions );
+    Layer::manageDimensions( inputTensor );
 }
 
 
@@ -262,31 +272,25 @@ void MaxPool2d::backward() {
     setInputTensorPointer(nullptr);
 }
 
-void MaxPool2d::manageDimensions( const Tensor& inputTensor ) {
-    if (inputTensor.dimensions.size() != 4) throw std::runtime_error("input tensor dimensionality must be four for MaxPool2d");
+TensorDims MaxPool2d::outputDimensions( const TensorDims& inputDimensions ) const {
+    if (inputDimensions.size() != 4) throw std::runtime_error("input tensor dimensionality must be four for MaxPool2d");
 
-    TensorDims neededOutTensorDims = { inputTensor.dimensions[0],
-                                       inputTensor.dimensions[1],
-                                       inputTensor.dimensions[2] / kernelSize,
-                                       inputTensor.dimensions[3] / kernelSize };
-
-    if (outputTensor.dimensions != neededOutTensorDims) {
-        adjustOutTensorDimensions(neededOutTensorDims);
-    }
+    return { inputDimensions[0], inputDimensions[1], inputDimensions[2] / kernelSize, inputDimensions[3] / kernelSize };
 }
 
 
-void Reparameterize::manageDimensions( const Tensor& inputTensor ) {
+TensorDims Reparameterize::outputDimensions( const TensorDims& inputDimensions ) const {
     #ifndef NDEBUG
-        if (inputTensor.dimensions[1] % 2 != 0 or inputTensor.dimensions.size() != 2) 
+        if (inputDimensions[1] % 2 != 0 or inputDimensions.size() != 2) 
             throw std::runtime_error("dimensions of distribution should be of size 2 and have n columns for means and n columns for logvariance");
     #endif
 
-    TensorDims neededOutDims = {inputTensor.dimensions[0], inputTensor.dimensions[1] / 2};
-    if (outputTensor.dimensions != neededOutDims) {
-        adjustOutTensorDimensions(neededOutDims);
-        currentEpsilons = Tensor::zeros(neededOutDims);
-    }
+    return {inputDimensions[0], inputDimensions[1] / 2};
+}
+
+void Reparameterize::manageDimensions( const Tensor& inputTensor ) {
+    Layer::manageDimensions( inputTensor );
+    if (GradMode::enabled() and currentEpsilons.dimensions != outputTensor.dimensions) currentEpsilons = Tensor::zeros(outputTensor.dimensions);
 }
 
 void Reparameterize::forward( Tensor& inputTensor ) {
@@ -294,13 +298,15 @@ void Reparameterize::forward( Tensor& inputTensor ) {
     manageDimensions( inputTensor );
     setInputTensorPointer( &inputTensor );
 
-    for (size_t i = 0; i < inputTensor.length; i += 2) {
-        dtype mean = inputTensor.data[i], std = std::exp(inputTensor.data[i + 1] / 2);
-
-        dtype epsilon = normDist(generator);
-        currentEpsilons.data[i / 2] = epsilon;
-        outputTensor.data[i / 2] = mean + epsilon * std;
-    }
+    // the epsilons are only kept for backward, in inference mode they're drawn straight into the output
+    dtype* epsilons = GradMode::enabled() ? currentEpsilons.data.get() : outputTensor.data.get();
+    generator.normal(epsilons, outputTensor.length);
+    parallelFor(0, outputTensor.length, grainFor(24), [&] (size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) {
+            dtype mean = inputTensor.data[2 * i], std = std::exp(inputTensor.data[2 * i + 1] / 2);
+            outputTensor.data[i] = mean + epsilons[i] * std;
+        }
+    });
 }
 
 void Reparameterize::backward() {
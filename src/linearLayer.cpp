@@ -2,52 +2,37 @@
 
 #include "mygrad/helper.hpp"
 #include "mygrad/linearLayer.hpp"
+#include "mygrad/gemm.hpp"
 #include "mygrad/threadPool.hpp"
 
 
 namespace mygrad {
 
 LinearLayer::LinearLayer( size_t inFeatures, size_t outFeatures,
-                          const std::vector<dtype>& data ) :
+                          const std::vector<dtype>& data, Activation activation ) :
     weights( data, { outFeatures, inFeatures } ), // the tensor is transposed for matrix multiplication to work nicely.
                                                  // each outFeatures row has InFeatures weights. 
     biases( std::vector<dtype>(outFeatures, 0), {1, outFeatures} ),
-    weightRowMutexes(outFeatures) {}
+    activation(activation) {}
     
 
-LinearLayer::LinearLayer( size_t inFeatures, size_t outFeatures) : // default init
+LinearLayer::LinearLayer( size_t inFeatures, size_t outFeatures, Activation activation ) : // default init
     LinearLayer( inFeatures, outFeatures,
-                 KaimingWeightsVector(inFeatures, outFeatures) ) {}
+                 KaimingWeightsVector(inFeatures, outFeatures), activation ) {}
 
 
 void LinearLayer::forward( Tensor& inputTensor ) {
     manageDimensions(inputTensor); 
     setInputTensorPointer( &inputTensor );
 
-    const size_t threads_n = ThreadPool::size();
-    const size_t chunkSize = std::ceil( (double) outputTensor.dimensions[0] / threads_n );
-    // std::cout << outputTensor.dimensions << "are the dimensions of the output\n";
-    // std::cout << chunkSize << " is the chunk size\n";
-
-    for (size_t t=0; t < threads_n; t++) {
-        size_t startRow = chunkSize * t, endRow = std::min(startRow+chunkSize, outputTensor.dimensions[0]); 
-        ThreadPool::push(
-            [this, startRow, endRow] {
-                for (size_t inputRow=startRow; inputRow < endRow; inputRow++) {
-                    for (size_t weightRow=0; weightRow < outputTensor.dimensions[1]; weightRow++) {
-                        outputTensor.at({inputRow, weightRow}) = std::transform_reduce( 
-                            &currentInputTensor->at({inputRow, 0}), 
-                            &currentInputTensor->at({inputRow, currentInputTensor->dimensions[1]}),
-                            &weights.at({weightRow, 0}),
-                            biases.at({0, weightRow})
-                        ); // dot product
-                    }
-                }
-            }
-        );
-    }
+    const size_t batchSize = inputTensor.dimensions[0], inFeatures = weights.dimensions[1], outFeatures = weights.dimensions[0];
 
-    ThreadPool::waitUntilDone();
+    // output = activation(input * weights^T + biases)
+    gemm( Transpose::No, Transpose::Yes, batchSize, outFeatures, inFeatures,
+          inputTensor.data.get(), inFeatures,
+          weights.data.get(), inFeatures,
+          outputTensor.data.get(), outFeatures,
+          false, biases.data.get(), activation );
 }
 
 void LinearLayer::backward() {
@@ -55,67 +40,66 @@ void LinearLayer::backward() {
         if (!(currentInputTensor)) throw std::runtime_error("backward before forward impossible");
     #endif
 
-    const size_t threads_n = ThreadPool::size();
-    const size_t rowChunkSize = std::ceil(outputTensor.dimensions[0] / (double) threads_n);
-    for (size_t t=0; t < threads_n; t++) {
-        size_t startRow = rowChunkSize * t, endRow = std::min(startRow+rowChunkSize, outputTensor.dimensions[0]); 
-        ThreadPool::push(
-
-            [this, startRow, endRow] () {
-                const size_t inpTensorColumns = currentInputTensor->dimensions[1];
-                const size_t weightColumns = weights.dimensions[1];
-
-                for (size_t inputRow=startRow; inputRow < endRow; inputRow++) {
-                    for (size_t weightRow=0; weightRow < outputTensor.dimensions[1]; weightRow++) {
-                        dtype currentGradPassedDown = outputTensor.gradAt({inputRow, weightRow});
-                        for (size_t dotProductIterator=0; dotProductIterator < currentInputTensor->dimensions[1]; dotProductIterator++) {
-                            
-                            currentInputTensor->grads[inputRow*inpTensorColumns + dotProductIterator] +=
-                                weights.data[weightRow*weightColumns + dotProductIterator] * currentGradPassedDown;
-                        }
-
-                        {
-                            std::lock_guard lock(weightRowMutexes[weightRow]);
-                            for (size_t dotProductIterator=0; dotProductIterator < currentInputTensor->dimensions[1]; dotProductIterator++) {
-    
-                                weights.grads[weightRow*weightColumns + dotProductIterator] += 
-                                    currentInputTensor->data[inputRow*inpTensorColumns + dotProductIterator] * currentGradPassedDown; 
-                            }
-                        }
-
-                        // turns out doing two loops and distributing the grads separately is slightly faster than doing one loop and everything at once. cool
-                        
-                        biases.grads[weightRow] += currentGradPassedDown;
-                    }
-                }
-            });
-    }
+    const size_t batchSize = outputTensor.dimensions[0], inFeatures = weights.dimensions[1], outFeatures = weights.dimensions[0];
 
-    ThreadPool::waitUntilDone();
+    // the output grads are turned into grads of the pre-activation output in place, by the same jobs that sum
+    // the batch for the bias grads: each job takes its own columns, so nothing has to be locked
+    parallelFor(0, outFeatures, grainFor(batchSize), [this, batchSize, outFeatures] (size_t startColumn, size_t endColumn) {
+        for (size_t row = 0; row < batchSize; row++) {
+            for (size_t column = startColumn; column < endColumn; column++) {
+                dtype& grad = outputTensor.grads[row * outFeatures + column];
+                if (activation != Activation::None) grad *= activationDerivative(activation, outputTensor.data[row * outFeatures + column]);
+                biases.grads[column] += grad;
+            }
+        }
+    });
+
+    // input grads += output grads * weights
+    gemm( Transpose::No, Transpose::No, batchSize, inFeatures, outFeatures,
+          outputTensor.grads.get(), outFeatures,
+          weights.data.get(), inFeatures,
+          currentInputTensor->grads.get(), inFeatures,
+          true );
+
+    // weight grads += output grads^T * input. gemm hands every job its own block of the weight grads,
+    // so the sum over the batch happens inside a job and nothing has to be locked
+    gemm( Transpose::Yes, Transpose::No, outFeatures, inFeatures, batchSize,
+          outputTensor.grads.get(), outFeatures,
+          currentInputTensor->data.get(), inFeatures,
+          weights.grads.get(), inFeatures,
+          true );
 
     setInputTensorPointer( nullptr );
 }
 
-void LinearLayer::manageDimensions(const Tensor& inputTensor) {
+PassCost LinearLayer::forwardCost() const {
+    const double batchSize = outputTensor.dimensions[0], inFeatures = weights.dimensions[1], outFeatures = weights.dimensions[0];
+    return { 2 * batchSize * inFeatures * outFeatures,
+             (batchSize * inFeatures + weights.length + biases.length + batchSize * outFeatures) * sizeof(dtype) };
+}
+
+PassCost LinearLayer::backwardCost() const {
+    // two products as big as the forward one, and every tensor's grads touched as well
+    const PassCost forward = forwardCost();
+    return { 2 * forward.flops, 2 * forward.bytes };
+}
+
+TensorDims LinearLayer::outputDimensions( const TensorDims& inputDimensions ) const {
     if (
-        inputTensor.dimensions.size() != 2
+        inputDimensions.size() != 2
     ) {
-        std::cout << inputTensor.dimensions;
+        std::cout << inputDimensions;
         throw std::runtime_error("dimensionality for linear layer input tensor must be 2. dimensions received are printed above");
     }
 
     if (
-        inputTensor.dimensions[1] != weights.dimensions[1]
+        inputDimensions[1] != weights.dimensions[1]
     ) {
-        std::cout << inputTensor.dimensions[1] << " != " << weights.dimensions[1] << "\n";
+        std::cout << inputDimensions[1] << " != " << weights.dimensions[1] << "\n";
         throw std::runtime_error("input tensor columns don't match weight tensor rows in linear layer. mismatch printed above");
     }
 
-    if (
-        inputTensor.dimensions[0] != outputTensor.dimensions[0] or weights.dimensions[0] != outputTensor.dimensions[1]
-    ) {
-        adjustOutTensorDimensions( {inputTensor.dimensions[0], weights.dimensions[0]} );
-    }
+    return {inputDimensions[0], weights.dimensions[0]};
 }
 
 } // namespace mygrad
\ No newline at end of file
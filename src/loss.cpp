@@ -4,9 +4,12 @@
 #include <numeric>
 #include <functional>
 #include <cmath>
+#include <algorithm>
 
 #include "mygrad/loss.hpp"
 #include "mygrad/helper.hpp"
+#include "mygrad/profiler.hpp"
+#include "mygrad/threadPool.hpp"
 
 namespace mygrad {
 
@@ -22,39 +25,75 @@ void CrossEntropyLoss::checkDimensions( Tensor& logits, const Tensor& labels ) {
         std::cerr << logits.dimensions[0] << " != " << labels.dimensions[0] << "\n";
         throw std::runtime_error("logits' first dimension must be the same as labels' first dimension for cross entropy loss");
     }
-    if (currentSoftmaxOutput.dimensions != logits.dimensions) {
+    if (GradMode::enabled() and currentSoftmaxOutput.dimensions != logits.dimensions) {
         currentSoftmaxOutput = Tensor::zeros(logits.dimensions);
     } 
 }
 
 
 dtype CrossEntropyLoss::operator()( Tensor& logits, const Tensor& labels ) { 
+    Profiler::Scope scope("CrossEntropyLoss", "forward");
+    scope.setCost(elementwiseCost(logits.length, 8, 2));
     checkDimensions( logits, labels );
     setInputPointers( &logits, &labels );
 
-    Tensor logSoftmaxedLogits = logits.substractColumn(logits.max(1).addColumn(logits.substractColumn(logits.max(1)).exp().sum(1).log()));
-    currentSoftmaxOutput = logSoftmaxedLogits.exp();
+    const size_t elementsInBatch = logits.dimensions[0], classes = logits.strides[0];
+    rowLosses.resize(elementsInBatch);
+
+    // one pass per row: log softmax = logit - (max + log(sum(exp(logit - max)))), of which only the softmax is kept,
+    // and only for backward, so not in inference mode
+    const bool keepSoftmax = GradMode::enabled();
+    parallelFor(0, elementsInBatch, grainFor(4 * classes), [&] (size_t startRow, size_t endRow) {
+        for (size_t row = startRow; row < endRow; row++) {
+            const dtype* rowLogits = &logits.data[row * classes];
+
+            dtype max = rowLogits[0];
+            for (size_t i = 1; i < classes; i++) max = std::max(max, rowLogits[i]);
+
+            dtype sum = 0;
+            if (keepSoftmax) {
+                dtype* rowSoftmax = &currentSoftmaxOutput.data[row * classes];
+                for (size_t i = 0; i < classes; i++) {
+                    rowSoftmax[i] = std::exp(rowLogits[i] - max);
+                    sum += rowSoftmax[i];
+                }
+
+                const dtype inverseSum = 1 / sum;
+                for (size_t i = 0; i < classes; i++) rowSoftmax[i] *= inverseSum;
+            } else {
+                for (size_t i = 0; i < classes; i++) sum += std::exp(rowLogits[i] - max);
+            }
+
+            const size_t label = static_cast<size_t>(labels.data[row]);
+            rowLosses[row] = max + std::log(sum) - rowLogits[label];
+        }
+    });
 
+    // summed in row order, so the loss doesn't depend on how the rows were split
     dtype loss = 0;
-    size_t elementsInBatch = logits.dimensions[0];
-    for (size_t i=0; i < elementsInBatch; i++) {
-        loss -= logSoftmaxedLogits.at({ i, static_cast<size_t>(labels.data[i]) });
-    }
+    for (size_t row = 0; row < elementsInBatch; row++) loss += rowLosses[row];
     return loss/static_cast<dtype>(elementsInBatch);
 } 
 
 void CrossEntropyLoss::backward() {
+    Profiler::Scope scope("CrossEntropyLoss", "backward");
     #ifndef NDEBUG
         if (!(labels) or !(logits)) throw std::runtime_error("backward before forward impossible");
     #endif
     
-    for (size_t i=0; i < labels->length; i++) {
-        currentSoftmaxOutput.at({ i, static_cast<size_t>(labels->data[i]) }) -= 1; // substract the one hot encoded vector of labels
-    }
-
-    for (size_t i=0; i < logits->length; i++) {
-        logits->grads[i] += currentSoftmaxOutput.data[i] / static_cast<dtype>(logits->dimensions[0]);
-    }
+    scope.setCost(elementwiseCost(logits->length, 2, 3));
+    const size_t elementsInBatch = logits->dimensions[0], classes = logits->strides[0];
+    const dtype inverseBatch = 1 / static_cast<dtype>(elementsInBatch);
+
+    // the grads of the mean loss are (softmax - one hot encoded labels) / batch size
+    parallelFor(0, elementsInBatch, grainFor(classes), [&] (size_t startRow, size_t endRow) {
+        for (size_t row = startRow; row < endRow; row++) {
+            const dtype* rowSoftmax = &currentSoftmaxOutput.data[row * classes];
+            dtype* rowGrads = &logits->grads[row * classes];
+            for (size_t i = 0; i < classes; i++) rowGrads[i] += rowSoftmax[i] * inverseBatch;
+            rowGrads[static_cast<size_t>(labels->data[row])] -= inverseBatch;
+        }
+    });
 
     setInputPointers( nullptr, nullptr );
 }
@@ -67,6 +106,8 @@ void MSEloss::checkDimensions( Tensor& outputs, const Tensor& labels ) {
 }
 
 dtype MSEloss::operator()( Tensor& outputs, const Tensor& labels ) {
+    Profiler::Scope scope("MSEloss", "forward");
+    scope.setCost(elementwiseCost(outputs.length, 3, 2));
     checkDimensions( outputs, labels );
     setInputPointers( &outputs, &labels );
 
@@ -85,11 +126,13 @@ dtype MSEloss::operator()( Tensor& outputs, const Tensor& labels ) {
 }
 
 void MSEloss::backward() {
+    Profiler::Scope scope("MSEloss", "backward");
 
     #ifndef NDEBUG
         if (!(labels) or !(outputs)) throw std::runtime_error("backward before forward impossible");
     #endif
     
+    scope.setCost(elementwiseCost(outputs->length, 4, 3));
     for (size_t i = 0; i < outputs->length; i++) {
         dtype gradient = 2 * (outputs->data[i] - labels->data[i]);
         if (reduction == "mean") gradient /= outputs->length;
@@ -102,6 +145,8 @@ void MSEloss::backward() {
 
 
 dtype KLdivWithStandardNormal::operator()( Tensor& distribution, dtype beta ) {
+    Profiler::Scope scope("KLdivWithStandardNormal", "forward");
+    scope.setCost(elementwiseCost(distribution.length, 3, 1));
     setInputPointers( &distribution );
     currentBeta = beta;
 
@@ -122,10 +167,12 @@ dtype KLdivWithStandardNormal::operator()( Tensor& distribution, dtype beta ) {
 }
 
 void KLdivWithStandardNormal::backward() {
+    Profiler::Scope scope("KLdivWithStandardNormal", "backward");
     #ifndef NDEBUG
         if (!(distribution) or (!currentBeta)) throw std::runtime_error("backward before forward impossible");
     #endif
 
+    scope.setCost(elementwiseCost(distribution->length, 3, 2));
     const dtype divisor = static_cast<dtype>(distribution->dimensions[0]) / currentBeta;
     for (size_t i = 0; i < distribution->length; i+=2) {
         dtype mean = distribution->data[i], logvar = distribution->data[i + 1];
@@ -0,0 +1,103 @@
+#include <map>
+#include <bit>
+#include <mutex>
+#include <vector>
+#include <cstring>
+
+#include "mygrad/memoryCache.hpp"
+
+namespace mygrad {
+
+size_t MemoryCache::limitBytes = size_t(1) << 30;
+
+static constexpr size_t SMALLEST_CLASS = 16;
+
+// rounds up to the next of four evenly spaced sizes between two powers of two
+static size_t sizeClass( size_t length ) {
+    if (length <= SMALLEST_CLASS) return SMALLEST_CLASS;
+    const size_t step = std::bit_floor(length - 1) / 4;
+    return (length + step - 1) / step * step;
+}
+
+struct Cache {
+    std::mutex mutex;
+    std::map<size_t, std::vector<dtype*>> freeBlocks; // by capacity, the lists are kept when they run empty
+    MemoryCache::Stats stats;
+};
+
+// never destroyed, so tensors with static storage can still give their memory back at exit
+static Cache& cache() {
+    static Cache* const instance = new Cache;
+    return *instance;
+}
+
+
+dtype* MemoryCache::allocate( size_t length, size_t& capacity ) {
+    const size_t needed = sizeClass(length);
+    Cache& c = cache();
+    dtype* memory = nullptr;
+    {
+        std::lock_guard lock(c.mutex);
+        for (auto blocks = c.freeBlocks.lower_bound(needed); blocks != c.freeBlocks.end() and blocks->first <= 2 * needed; ++blocks) {
+            if (blocks->second.empty()) continue;
+            memory = blocks->second.back(), capacity = blocks->first;
+            blocks->second.pop_back();
+            c.stats.hits++;
+            c.stats.cachedBytes -= capacity * sizeof(dtype);
+            c.stats.usedBytes += capacity * sizeof(dtype);
+            break;
+        }
+    }
+
+    if (!memory) {
+        // only what's used is zeroed, so the pages of the rest of a big block aren't touched
+        capacity = needed;
+        memory = new dtype[capacity];
+        std::lock_guard lock(c.mutex);
+        c.stats.misses++;
+        c.stats.usedBytes += capacity * sizeof(dtype);
+    }
+    std::memset(memory, 0, length * sizeof(dtype));
+    return memory;
+}
+
+void MemoryCache::release( dtype* memory, size_t capacity ) {
+    if (!memory) return;
+    Cache& c = cache();
+    {
+        std::lock_guard lock(c.mutex);
+        c.stats.usedBytes -= capacity * sizeof(dtype);
+        if (c.stats.cachedBytes + capacity * sizeof(dtype) <= limitBytes) {
+            c.freeBlocks[capacity].push_back(memory);
+            c.stats.cachedBytes += capacity * sizeof(dtype);
+            return;
+        }
+        c.stats.releases++;
+    }
+    delete[] memory;
+}
+
+void MemoryCache::emptyCache() {
+    Cache& c = cache();
+    std::lock_guard lock(c.mutex);
+    for (auto& [capacity, blocks] : c.freeBlocks) {
+        for (dtype* memory : blocks) delete[] memory;
+        c.stats.releases += blocks.size();
+    }
+    c.freeBlocks.clear();
+    c.stats.cachedBytes = 0;
+}
+
+MemoryCache::Stats MemoryCache::stats() {
+    Cache& c = cache();
+    std::lock_guard lock(c.mutex);
+    return c.stats;
+}
+
+void MemoryCache::resetStats() {
+    Cache& c = cache();
+    std::lock_guard lock(c.mutex);
+    c.stats.hits = c.stats.misses = c.stats.releases = 0;
+}
+
+} // namespace mygrad
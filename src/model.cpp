@@ -1,7 +1,15 @@
 #include <fstream>
+#include <chrono>
+#include <string_view>
 #include <stdexcept>
+#include <vector>
+#include <new>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
 #include "mygrad/model.hpp"
 #include "mygrad/helper.hpp"
+#include "mygrad/profiler.hpp"
 
 namespace mygrad {
 
@@ -11,6 +19,8 @@ const std::vector<Tensor*> Model::parametersOfLayers(LayersContainer& layers) {
         const std::vector<Tensor*>& parametersOfLayer = layers[i].parameterTensors();
         parameterTensors.insert(parameterTensors.end(), parametersOfLayer.begin(), parametersOfLayer.end());
     }
+    // the parameters keep their grads even in a model made in inference mode, checkpoints and Adam expect them
+    for (Tensor* const parameterTensor : parameterTensors) parameterTensor->allocateGrads();
     return parameterTensors;
 }
 
@@ -23,20 +33,298 @@ const std::vector<Tensor*> Model::nonParametersOfLayers(LayersContainer& layers)
     return nonParameterTensors;
 }
 
+static size_t lengthOf( const std::vector<Tensor*>& tensors ) {
+    size_t length = 0;
+    for (const Tensor* const tensor : tensors) length += tensor->length;
+    return length;
+}
+
+
+static constexpr size_t PACKED_ALIGNMENT = 64; // a cache line, and the widest vector registers
+
+void Model::AlignedDeleter::operator()( dtype* memory ) const {
+    ::operator delete[](memory, std::align_val_t(PACKED_ALIGNMENT));
+}
+
+static dtype* allocateAligned( size_t length ) {
+    return static_cast<dtype*>(::operator new[](std::max<size_t>(length, 1) * sizeof(dtype), std::align_val_t(PACKED_ALIGNMENT)));
+}
+
+void Model::packParameters() {
+    if (packed()) return;
+
+    const size_t length = lengthOf(parameters);
+    packedData.reset(allocateAligned(length));
+    packedGrads.reset(allocateAligned(length));
+    Profiler::recordAllocation(2 * length * sizeof(dtype));
+
+    size_t offset = 0;
+    for (Tensor* const parameterTensor : parameters) {
+        parameterTensor->moveInto(&packedData[offset], &packedGrads[offset]);
+        offset += parameterTensor->length;
+    }
+}
+
+
+// a buffer to be placed in the arena, alive from step first to step last of a pass, both included, once or twice
+struct PlannedBuffer {
+    struct Life { size_t first, last; };
+
+    size_t length;
+    std::vector<Life> lives;
+    size_t* offset;
+
+    bool overlaps( const PlannedBuffer& other ) const {
+        for (const Life& life : lives) {
+            for (const Life& otherLife : other.lives) {
+                if (otherLife.first <= life.last and life.first <= otherLife.last) return true;
+            }
+        }
+        return false;
+    }
+};
+
+// first fit, biggest buffer first: each goes at the lowest offset where it overlaps none of the buffers placed before
+// it that are alive at the same time. returns the length of the arena
+static size_t placeBuffers( std::vector<PlannedBuffer>& buffers ) {
+    std::stable_sort(buffers.begin(), buffers.end(), [] (const PlannedBuffer& a, const PlannedBuffer& b) { return a.length > b.length; });
+
+    std::vector<const PlannedBuffer*> placed, overlapping;
+    size_t arenaLength = 0;
+    for (PlannedBuffer& buffer : buffers) {
+        overlapping.clear();
+        for (const PlannedBuffer* const other : placed) {
+            if (buffer.overlaps(*other)) overlapping.push_back(other);
+        }
+        std::sort(overlapping.begin(), overlapping.end(), [] (const PlannedBuffer* a, const PlannedBuffer* b) { return *a->offset < *b->offset; });
+
+        size_t offset = 0;
+        for (const PlannedBuffer* const other : overlapping) {
+            if (offset + buffer.length <= *other->offset) break;
+            offset = std::max(offset, *other->offset + other->length);
+        }
+        *buffer.offset = offset;
+        arenaLength = std::max(arenaLength, offset + buffer.length);
+        placed.push_back(&buffer);
+    }
+    return arenaLength;
+}
+
+// what the planner needs to know of a layer
+struct PlannedLayer {
+    size_t length;
+    bool readsInput, readsOutput;
+    bool recomputed; // inside a checkpointed segment, so run again by backward
+};
+
+// lays the outputs of the layers out in an arena by when they're alive, with the grads too if withGrads. returns the
+// length of the arena
+static size_t layOutOutputs( const std::vector<PlannedLayer>& layers, bool withGrads, std::vector<size_t>& dataOffsets,
+                             std::vector<size_t>& gradsOffsets ) {
+    const size_t n = layers.size();
+
+    // the steps of a pass: the forwards of the layers in turn, then their backwards the other way round, with the
+    // forwards of a checkpointed segment run again right before the backward of the layer after them
+    std::vector<size_t> forwardStep(n), recomputeStep(n), backwardStep(n);
+    size_t step = 0;
+    for (size_t i = 0; i < n; i++) forwardStep[i] = step++;
+    for (size_t i = n; withGrads and i-- > 0;) {
+        if (i > 0 and layers[i - 1].recomputed and !layers[i].recomputed) {
+            size_t first = i - 1;
+            while (first > 0 and layers[first - 1].recomputed) first--;
+            for (size_t k = first; k < i; k++) recomputeStep[k] = step++;
+        }
+        backwardStep[i] = step++;
+    }
+    const size_t lastStep = withGrads ? step - 1 : step;
+
+    // every buffer starts on a cache line
+    constexpr size_t ALIGNMENT = PACKED_ALIGNMENT / sizeof(dtype);
+    auto aligned = [] (size_t length) { return (length + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; };
+
+    std::vector<PlannedBuffer> buffers;
+    for (size_t i = 0; i < n; i++) {
+        const size_t length = aligned(layers[i].length);
+
+        // the model's output is read after the forward by whatever comes next, so it's kept the whole pass
+        if (i == n - 1) {
+            buffers.push_back({ length, { { forwardStep[i], lastStep } }, &dataOffsets[i] });
+            if (withGrads) buffers.push_back({ length, { { 0, lastStep } }, &gradsOffsets[i] });
+            continue;
+        }
+
+        // read by the next forward, and in grad mode maybe by it run again and by the backwards
+        size_t lastRead = forwardStep[i + 1];
+        if (withGrads) {
+            if (layers[i + 1].recomputed) lastRead = recomputeStep[i + 1];
+            if (layers[i + 1].readsInput) lastRead = backwardStep[i + 1];
+            if (layers[i].readsOutput) lastRead = backwardStep[i];
+            buffers.push_back({ length, { { backwardStep[i + 1], backwardStep[i] } }, &gradsOffsets[i] });
+        }
+        if (layers[i].recomputed) {
+            // dropped once the next forward is done with it, and back when it's run again
+            buffers.push_back({ length, { { forwardStep[i], forwardStep[i + 1] }, { recomputeStep[i], std::max(recomputeStep[i], lastRead) } },
+                               &dataOffsets[i] });
+        } else {
+            buffers.push_back({ length, { { forwardStep[i], lastRead } }, &dataOffsets[i] });
+        }
+    }
+    return placeBuffers(buffers);
+}
+
+const MemoryPlan& Model::planMemory( const TensorDims& inputDimensions ) {
+    const size_t n = layers.size();
+    MemoryPlan newPlan { .inputDimensions = inputDimensions, .withGrads = GradMode::enabled() };
+    newPlan.outputDimensions.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        newPlan.outputDimensions.push_back(layers[i].outputDimensions(i ? newPlan.outputDimensions[i - 1] : inputDimensions));
+    }
+    newPlan.dataOffsets.resize(n), newPlan.gradsOffsets.resize(n);
+
+    std::vector<PlannedLayer> plannedLayers;
+    for (size_t i = 0; i < n; i++) {
+        const size_t length = Tensor::lengthFromDimensions(newPlan.outputDimensions[i]);
+        newPlan.naiveBytes += (newPlan.withGrads ? 2 : 1) * length * sizeof(dtype);
+        plannedLayers.push_back({ length, layers[i].backwardReadsInput(), layers[i].backwardReadsOutput(), false });
+    }
+
+    // the checkpointed segments only change anything when there's a backward. each one's saving is measured
+    // against a plan without any
+    if (newPlan.withGrads and !segments.empty()) {
+        std::vector<size_t> dataOffsets(n), gradsOffsets(n);
+        const size_t lengthWithoutSegments = layOutOutputs(plannedLayers, true, dataOffsets, gradsOffsets);
+        for (CheckpointedSegment& segment : segments) {
+            std::vector<PlannedLayer> withSegment = plannedLayers;
+            for (size_t k = segment.firstLayer; k < segment.lastLayer; k++) withSegment[k].recomputed = true;
+            const size_t length = layOutOutputs(withSegment, true, dataOffsets, gradsOffsets);
+            segment.savedBytes = (std::max(lengthWithoutSegments, length) - length) * sizeof(dtype);
+        }
+        for (const CheckpointedSegment& segment : segments) {
+            for (size_t k = segment.firstLayer; k < segment.lastLayer; k++) plannedLayers[k].recomputed = true;
+        }
+    }
+    const size_t arenaLength = layOutOutputs(plannedLayers, newPlan.withGrads, newPlan.dataOffsets, newPlan.gradsOffsets);
+    newPlan.plannedBytes = arenaLength * sizeof(dtype);
+
+    // zeroed, for the grads of the output, which are the caller's to zero from then on
+    std::unique_ptr<dtype[], AlignedDeleter> newArena(allocateAligned(arenaLength));
+    std::fill(newArena.get(), newArena.get() + arenaLength, dtype(0));
+    Profiler::recordAllocation(newPlan.plannedBytes);
+
+    // the old arena goes once no layer points into it
+    activationArena.swap(newArena);
+    plan = std::move(newPlan);
+    usePlannedMemory();
+    return *plan;
+}
+
+void Model::usePlannedMemory() {
+    for (size_t i = 0; i < layers.size(); i++) {
+        Tensor& output = layers[i].outputTensor;
+        dtype* const data = &activationArena[plan->dataOffsets[i]];
+        if (output.data.get() == data) continue;
+        output = Tensor::view(data, plan->withGrads ? &activationArena[plan->gradsOffsets[i]] : nullptr, plan->outputDimensions[i]);
+    }
+}
+
+void Model::checkpoint( size_t firstLayer, size_t lastLayer ) {
+    if (plan) throw std::runtime_error("checkpointed segments have to be marked before the memory is planned");
+    if (firstLayer >= lastLayer or lastLayer >= layers.size()) throw std::runtime_error("a checkpointed segment needs two or more of the model's layers");
+    for (const CheckpointedSegment& segment : segments) {
+        if (firstLayer <= segment.lastLayer and segment.firstLayer <= lastLayer) throw std::runtime_error("checkpointed segments can't share layers");
+    }
+    for (size_t k = firstLayer; k < lastLayer; k++) {
+        if (!layers[k].deterministic()) throw std::runtime_error(std::string("a ") + layers[k].name() + " can't be run again in a checkpointed segment");
+    }
+
+    segments.push_back({ firstLayer, lastLayer });
+    std::sort(segments.begin(), segments.end(), [] (const CheckpointedSegment& a, const CheckpointedSegment& b) { return a.firstLayer < b.firstLayer; });
+}
+
+
+// checkpoints start with this, then the size of a value and the number of them in the model, then the data of all
+// the parameters and after it all their grads. files without it are from before, with the data and grads of every
+// tensor in turn
+static constexpr char CHECKPOINT_MAGIC[8] = { 'm', 'y', 'g', 'r', 'a', 'd', '2', '\0' };
+
 void Model::save(const std::string& filename) const {
     std::ofstream file(filename, std::ios::binary);
     if (!file.is_open()) throw std::runtime_error("failed to open file " + filename);
 
+    const uint64_t valueSize = sizeof(dtype), values = lengthOf(parameters);
+    file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    file.write(reinterpret_cast<const char*>(&valueSize), sizeof(valueSize));
+    file.write(reinterpret_cast<const char*>(&values), sizeof(values));
+
+    if (packed()) {
+        file.write(reinterpret_cast<const char*>(packedData.get()), values*sizeof(dtype));
+        file.write(reinterpret_cast<const char*>(packedGrads.get()), values*sizeof(dtype));
+        return;
+    }
+    for (const Tensor* const parameterTensor : parameters) {
+        file.write(reinterpret_cast<const char*>(parameterTensor->data.get()), parameterTensor->length*sizeof(dtype));
+    }
     for (const Tensor* const parameterTensor : parameters) {
-        file.write(reinterpret_cast<char*>(parameterTensor->data.get()), parameterTensor->length*sizeof(dtype));
-        file.write(reinterpret_cast<char*>(parameterTensor->grads.get()), parameterTensor->length*sizeof(dtype));
+        file.write(reinterpret_cast<const char*>(parameterTensor->grads.get()), parameterTensor->length*sizeof(dtype));
     }
 }
 
 void Model::load(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary);
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
     if (!file.is_open()) throw std::runtime_error("failed to open file " + filename);
 
+    const size_t fileSize = file.tellg();
+    file.seekg(0);
+
+    const size_t parametersLength = lengthOf(parameters);
+
+    char magic[sizeof(CHECKPOINT_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    if (file and std::equal(magic, magic + sizeof(magic), CHECKPOINT_MAGIC)) {
+        uint64_t valueSize = 0, values = 0;
+        file.read(reinterpret_cast<char*>(&valueSize), sizeof(valueSize));
+        file.read(reinterpret_cast<char*>(&values), sizeof(values));
+        if (values != parametersLength or (valueSize != sizeof(dtype) and valueSize != sizeof(double)))
+            throw std::runtime_error("the parameters in " + filename + " don't match the model's");
+
+        // a model saved by a double build is narrowed on the way in
+        std::vector<double> buffer;
+        auto read = [&file, &buffer, valueSize] (dtype* destination, size_t length) {
+            if (valueSize == sizeof(dtype)) {
+                file.read(reinterpret_cast<char*>(destination), length*sizeof(dtype));
+                return;
+            }
+            buffer.resize(length);
+            file.read(reinterpret_cast<char*>(buffer.data()), length*sizeof(double));
+            std::copy(buffer.begin(), buffer.end(), destination);
+        };
+
+        if (packed()) {
+            read(packedData.get(), parametersLength);
+            read(packedGrads.get(), parametersLength);
+        } else {
+            for (Tensor* const parameterTensor : parameters) read(parameterTensor->data.get(), parameterTensor->length);
+            for (Tensor* const parameterTensor : parameters) read(parameterTensor->grads.get(), parameterTensor->length);
+        }
+        if (!file) throw std::runtime_error(filename + " ends before all the parameters are read");
+        return;
+    }
+    file.clear();
+    file.seekg(0);
+
+    if (sizeof(dtype) != sizeof(double) and fileSize == 2 * parametersLength * sizeof(double)) {
+        // the model was saved by a double build, narrow it on the way in
+        std::vector<double> buffer;
+        for (Tensor* const parameterTensor : parameters) {
+            buffer.resize(parameterTensor->length);
+            file.read(reinterpret_cast<char*>(buffer.data()), parameterTensor->length*sizeof(double));
+            std::copy(buffer.begin(), buffer.end(), parameterTensor->data.get());
+            file.read(reinterpret_cast<char*>(buffer.data()), parameterTensor->length*sizeof(double));
+            std::copy(buffer.begin(), buffer.end(), parameterTensor->grads.get());
+        }
+        return;
+    }
+
     for (Tensor* const parameterTensor : parameters) {
         file.read(reinterpret_cast<char*>(parameterTensor->data.get()), parameterTensor->length*sizeof(dtype));
         file.read(reinterpret_cast<char*>(parameterTensor->grads.get()), parameterTensor->length*sizeof(dtype));
@@ -56,17 +344,44 @@ void Model::printGrads() const {
 }
 
 void Model::zeroGrad() {
-    for (size_t i = 0; i < layers.size(); i++) {
-        layers[i].zeroGrad();
+    if (packed()) std::memset(packedGrads.get(), 0, lengthOf(parameters)*sizeof(dtype));
+    else for (Tensor* const parameterTensor : parameters) parameterTensor->zeroGrad();
+
+    // but for the model's output, the grads of outputs in planned memory are zeroed by backward right before they're
+    // written, until then the memory may hold other outputs. they're the only views among the layers' tensors
+    const Tensor* const output = &layers[layers.size() - 1].outputTensor;
+    for (Tensor* const nonParameterTensor : nonParameters) {
+        if (!nonParameterTensor->isView() or nonParameterTensor == output) nonParameterTensor->zeroGrad();
+    }
+}
+
+
+// runs a pass of a layer, timed by the profiler when it's on. the category is forward, backward, or recompute for
+// a forward run again for a checkpointed segment
+template <typename Pass>
+static void profiledPass( const std::string& modelName, size_t index, Layer& layer, const char* category, Pass&& pass ) {
+    if (!Profiler::enabled()) {
+        pass();
+        return;
     }
+
+    // the shapes are only known after a forward pass, and backward lets go of the input
+    const bool forward = std::string_view(category) != "backward";
+    Profiler::Scope scope((modelName.empty() ? "" : modelName + " ") + std::to_string(index) + " " + layer.name(), category);
+    if (!forward) scope.setCost(layer.backwardCost());
+    pass();
+    if (forward) scope.setCost(layer.forwardCost());
 }
 
 
 Tensor& Model::forward(Tensor& x) {
+    const bool onPlan = plan and x.dimensions == plan->inputDimensions and (plan->withGrads or !GradMode::enabled());
+    if (onPlan) usePlannedMemory();
+    forwardOnPlan = onPlan and GradMode::enabled();
 
-    layers[0].forward(x);
+    profiledPass(name, 0, layers[0], "forward", [&] { layers[0].forward(x); });
     for (size_t i = 1; i < layers.size(); i++){
-        layers[i].forward(layers[i-1].outputTensor);
+        profiledPass(name, i, layers[i], "forward", [&] { layers[i].forward(layers[i-1].outputTensor); });
     }
     return layers[layers.size() - 1].outputTensor;
 };
@@ -78,10 +393,42 @@ Tensor& Model::operator()(Tensor& x) {
 
 
 void Model::backward() {
+    #ifndef NDEBUG
+        if (!layers[layers.size() - 1].outputTensor.hasGrads()) throw std::runtime_error("backward after a forward in inference mode impossible");
+    #endif
+    // without the plan every output is still there
+    const bool recomputing = forwardOnPlan and !segments.empty();
+    double forwardFlops = 0;
+    if (recomputing) {
+        for (size_t i = 0; i < layers.size(); i++) forwardFlops += layers[i].forwardCost().flops;
+    }
+
+    auto segment = segments.rbegin();
     for (int i = layers.size() - 1; i >= 0; i--) {
-        layers[i].backward();
+        if (recomputing and segment != segments.rend() and segment->lastLayer == static_cast<size_t>(i)) {
+            segment->forwardFlops = forwardFlops;
+            recompute(*segment++);
+        }
+        if (i > 0 and layers[i - 1].outputTensor.isView()) layers[i - 1].outputTensor.zeroGrad();
+        profiledPass(name, i, layers[i], "backward", [&] { layers[i].backward(); });
     }
 }
 
+void Model::recompute( CheckpointedSegment& segment ) {
+    const auto start = std::chrono::steady_clock::now();
+
+    // the first layer's backward hasn't run yet, so it still points at its input
+    double flops = 0;
+    for (size_t k = segment.firstLayer; k < segment.lastLayer; k++) {
+        Tensor& input = k == segment.firstLayer ? *layers[k].currentInputTensor : layers[k - 1].outputTensor;
+        profiledPass(name, k, layers[k], "recompute", [&] { layers[k].forward(input); });
+        flops += layers[k].forwardCost().flops;
+    }
+
+    segment.recomputeFlops = flops;
+    segment.recomputeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    segment.recomputes++;
+}
+
 
 } // namespace mygrad
\ No newline at end of file
@@ -1,47 +1,77 @@
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include "mygrad/optim.hpp"
 #include "mygrad/threadPool.hpp"
+#include "mygrad/profiler.hpp"
 
 namespace mygrad {
 
+static constexpr size_t WORK_PER_PARAMETER = 12;
+
 Adam::Adam(const std::vector<Tensor*>& parameters, dtype learningRate, 
            dtype beta1, dtype beta2, dtype epsilon, dtype weightDecay) :
 
         learningRate(learningRate), beta1(beta1), beta2(beta2), 
-        epsilon(epsilon), weightDecay(weightDecay), paramsAndGrads() {
+        epsilon(epsilon), weightDecay(weightDecay), parameters(parameters) {
 
-            paramsAndGrads.reserve(sizeOfParamsAndGradsFromParameters(parameters));
+            offsets.reserve(parameters.size() + 1);
+            offsets.push_back(0);
             for (const Tensor* const param : parameters) {
-                for (size_t i = 0; i < param->length; i++) {
-                    paramsAndGrads.push_back( dataAndGrads( param->data[i], param->grads[i] ) );
-                }
+                offsets.push_back(offsets.back() + param->length);
             }
+            firstMoments.resize(offsets.back());
+            secondMoments.resize(offsets.back());
         }
 
+// the whole update of one parameter in a single pass over its four arrays, which the compiler vectorizes.
+// the bias corrections come in folded into stepSize and secondCorrection, as they're the same for every parameter.
+// weight decay is added to the grads themselves, as it always was, but without it they're only read
+template <bool withWeightDecay>
+static void adamUpdate( dtype* __restrict data, dtype* __restrict grads, dtype* __restrict first,
+                        dtype* __restrict second, size_t length, dtype beta1, dtype beta2,
+                        dtype stepSize, dtype secondCorrection, dtype epsilon, dtype weightDecay ) {
+    for (size_t i = 0; i < length; i++) {
+        dtype grad = grads[i];
+        if constexpr (withWeightDecay) grads[i] = grad += weightDecay*data[i];
+        first[i] = beta1*first[i] + (1 - beta1)*grad;
+        second[i] = beta2*second[i] + (1 - beta2)*grad*grad;
+        data[i] -= stepSize*first[i] / (std::sqrt(second[i]*secondCorrection) + epsilon);
+    }
+}
+
 void Adam::step() {
+    Profiler::Scope scope("Adam::step", "optimizer");
+    const size_t totalLength = offsets.back();
+    // about a dozen operations per parameter, a sqrt among them, reading four values and writing three
+    scope.setCost({ 12.0 * totalLength, (weightDecay != 0 ? 8.0 : 7.0) * totalLength * sizeof(dtype) });
     stepsMade++;
 
-    const size_t threads_n = ThreadPool::size();
-    const size_t chunkSize = std::ceil(paramsAndGrads.size() / (double) threads_n);
-    for (size_t t=0; t < threads_n; t++) {
-        size_t start = chunkSize * t, end = std::min(start+chunkSize, paramsAndGrads.size()); 
-        ThreadPool::push([this, start, end] {
-            for (size_t i = start; i < end; i++) {
-                dtype& data = paramsAndGrads[i].data, &grad = paramsAndGrads[i].grad;
-                dtype& gradRunAvg = paramsAndGrads[i].gradRunAvg, &gradSqRunAvg = paramsAndGrads[i].gradSqRunAvg;
-                grad += weightDecay*data;
-                gradRunAvg = ( beta1*gradRunAvg + (1 - beta1)*grad );
-                gradSqRunAvg = ( beta2*gradSqRunAvg + (1 - beta2)*grad*grad );
-
-                dtype gradRunAvgCorrected = gradRunAvg / (1 - std::pow(beta1, stepsMade));
-                dtype gradSqRunAvgCorrected = gradSqRunAvg / (1 - std::pow(beta2, stepsMade));
-
-                data -= learningRate*gradRunAvgCorrected / (std::sqrt(gradSqRunAvgCorrected) + epsilon);
-            }
-        });
-    }
-    ThreadPool::waitUntilDone();
+    const dtype stepSize = learningRate / (1 - std::pow(beta1, stepsMade));
+    const dtype secondCorrection = 1 / (1 - std::pow(beta2, stepsMade));
+
+    // one split over all the parameters laid end to end, so a chunk may take the end of one tensor and the start of
+    // the next, and the many small tensors of biases don't each cost a round of jobs. tensors that follow each other
+    // in memory too go into the same run of the kernel, so a packed model is a single one per chunk
+    parallelFor(0, totalLength, grainFor(WORK_PER_PARAMETER), [&] (size_t start, size_t end) {
+        size_t tensor = std::upper_bound(offsets.begin(), offsets.end(), start) - offsets.begin() - 1;
+        for (; start < end; tensor++) {
+            dtype* data = parameters[tensor]->data.get() + (start - offsets[tensor]);
+            dtype* grads = parameters[tensor]->grads.get() + (start - offsets[tensor]);
+            size_t runEnd = std::min(end, offsets[tensor + 1]);
+            while (runEnd < end and continuesInMemory(tensor)) runEnd = std::min(end, offsets[++tensor + 1]);
+
+            auto update = weightDecay != 0 ? adamUpdate<true> : adamUpdate<false>;
+            update(data, grads, &firstMoments[start], &secondMoments[start], runEnd - start, beta1, beta2, stepSize,
+                   secondCorrection, epsilon, weightDecay);
+            start = runEnd;
+        }
+    });
+}
+
+bool Adam::continuesInMemory( size_t tensor ) const {
+    const Tensor& current = *parameters[tensor], &next = *parameters[tensor + 1];
+    return next.data.get() == current.data.get() + current.length and next.grads.get() == current.grads.get() + current.length;
 }
 
-} // namespace mygrad
\ No newline at end of file
+} // namespace mygrad
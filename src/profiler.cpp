@@ -0,0 +1,188 @@
+#include "mygrad/profiler.hpp"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <limits>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+namespace mygrad {
+
+struct Event {
+    std::string name;
+    const char* category;
+    int64_t start, duration; // steady clock nanoseconds
+    PassCost cost;
+    size_t allocatedBytes, allocations;
+};
+
+// the events of one thread. the registry keeps them too, as threads outside the pool may be gone by the time the
+// results are read
+struct ThreadEvents {
+    size_t track;
+    std::string threadName;
+    std::vector<Event> events;
+};
+
+static std::mutex registryMutex;
+static std::vector<std::shared_ptr<ThreadEvents>> registry;
+
+static thread_local std::shared_ptr<ThreadEvents> threadEvents;
+static thread_local std::string threadName;
+static thread_local Profiler::Scope* innermostScope = nullptr;
+
+static int64_t nanosecondsNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static ThreadEvents& ownEvents() {
+    if (!threadEvents) {
+        threadEvents = std::make_shared<ThreadEvents>();
+        std::lock_guard lock(registryMutex);
+        threadEvents->track = registry.size();
+        threadEvents->threadName = threadName.empty() ? "thread " + std::to_string(registry.size()) : threadName;
+        registry.push_back(threadEvents);
+    }
+    return *threadEvents;
+}
+
+
+void Profiler::start() { on.store(true); }
+void Profiler::stop() { on.store(false); }
+
+void Profiler::clear() {
+    std::lock_guard lock(registryMutex);
+    for (const auto& thread : registry) thread->events.clear();
+}
+
+void Profiler::nameThread( std::string name ) {
+    if (threadEvents) {
+        std::lock_guard lock(registryMutex);
+        threadEvents->threadName = name;
+    }
+    threadName = std::move(name);
+}
+
+void Profiler::addAllocation( size_t bytes ) {
+    if (!innermostScope) return;
+    innermostScope->allocatedBytes += bytes;
+    innermostScope->allocations++;
+}
+
+
+Profiler::Scope::Scope( std::string_view name, const char* category ) : category(category) {
+    if (!enabled()) return;
+    this->name = name;
+    outer = std::exchange(innermostScope, this);
+    startedAt = nanosecondsNow();
+}
+
+Profiler::Scope::~Scope() {
+    if (!active()) return;
+    const int64_t end = nanosecondsNow();
+    innermostScope = outer;
+    ownEvents().events.push_back({ std::move(name), category, startedAt, end - startedAt, cost, allocatedBytes, allocations });
+}
+
+
+void Profiler::printSummary( std::ostream& out ) {
+    struct Totals { size_t calls = 0; int64_t nanoseconds = 0; double flops = 0, bytes = 0; size_t allocatedBytes = 0; };
+    std::map<std::pair<std::string, std::string>, Totals> passes;
+    std::vector<std::tuple<std::string, size_t, int64_t>> jobsPerThread; // thread, jobs, nanoseconds
+    int64_t profiledNanoseconds = 0;
+
+    {
+        std::lock_guard lock(registryMutex);
+        for (const auto& thread : registry) {
+            size_t jobs = 0;
+            int64_t jobNanoseconds = 0;
+            for (const Event& event : thread->events) {
+                if (std::string_view(event.category) == "job") {
+                    jobs++, jobNanoseconds += event.duration;
+                    continue;
+                }
+                Totals& totals = passes[{ event.category, event.name }];
+                totals.calls++;
+                totals.nanoseconds += event.duration;
+                totals.flops += event.cost.flops, totals.bytes += event.cost.bytes;
+                totals.allocatedBytes += event.allocatedBytes;
+                profiledNanoseconds += event.duration;
+            }
+            if (jobs) jobsPerThread.emplace_back(thread->threadName, jobs, jobNanoseconds);
+        }
+    }
+
+    std::vector<std::pair<std::pair<std::string, std::string>, Totals>> sorted(passes.begin(), passes.end());
+    std::sort(sorted.begin(), sorted.end(), [] (const auto& a, const auto& b) { return a.second.nanoseconds > b.second.nanoseconds; });
+
+    const std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::left << std::setw(10) << "pass" << std::setw(28) << "name" << std::right
+        << std::setw(8) << "calls" << std::setw(12) << "total ms" << std::setw(12) << "mean us" << std::setw(8) << "%"
+        << std::setw(10) << "GFLOP/s" << std::setw(9) << "GB/s" << std::setw(14) << "allocated MB" << "\n";
+
+    for (const auto& [key, totals] : sorted) {
+        const double seconds = std::max<double>(totals.nanoseconds, 1) * 1e-9;
+        out << std::left << std::setw(10) << key.first << std::setw(28) << key.second << std::right
+            << std::setw(8) << totals.calls
+            << std::setw(12) << std::setprecision(2) << totals.nanoseconds * 1e-6
+            << std::setw(12) << std::setprecision(1) << totals.nanoseconds * 1e-3 / totals.calls
+            << std::setw(8) << std::setprecision(1) << 100.0 * totals.nanoseconds / std::max<int64_t>(profiledNanoseconds, 1)
+            << std::setw(10) << std::setprecision(2) << totals.flops * 1e-9 / seconds
+            << std::setw(9) << std::setprecision(2) << totals.bytes * 1e-9 / seconds
+            << std::setw(14) << std::setprecision(2) << totals.allocatedBytes / double(1 << 20) << "\n";
+    }
+
+    if (!jobsPerThread.empty()) out << "\njobs run on the pool:\n";
+    for (const auto& [thread, jobs, nanoseconds] : jobsPerThread) {
+        out << "  " << std::left << std::setw(16) << thread << std::right << std::setw(10) << jobs << " jobs"
+            << std::setw(12) << std::setprecision(2) << nanoseconds * 1e-6 << " ms\n";
+    }
+    out.flags(flags);
+}
+
+
+static std::string escaped( const std::string& text ) {
+    std::string result;
+    for (char c : text) {
+        if (c == '"' or c == '\\') result += '\\';
+        result += c;
+    }
+    return result;
+}
+
+void Profiler::writeChromeTrace( const std::string& filename ) {
+    std::ofstream file(filename);
+    if (!file.is_open()) throw std::runtime_error("failed to open file " + filename);
+
+    std::lock_guard lock(registryMutex);
+    int64_t origin = std::numeric_limits<int64_t>::max();
+    for (const auto& thread : registry) {
+        for (const Event& event : thread->events) origin = std::min(origin, event.start);
+    }
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    for (const auto& thread : registry) {
+        file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << thread->track
+             << ", \"args\": {\"name\": \"" << escaped(thread->threadName) << "\"}}";
+        first = false;
+
+        for (const Event& event : thread->events) {
+            file << ",\n{\"name\": \"" << escaped(event.name) << "\", \"cat\": \"" << event.category
+                 << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << thread->track << std::fixed << std::setprecision(3)
+                 << ", \"ts\": " << (event.start - origin) * 1e-3 << ", \"dur\": " << event.duration * 1e-3
+                 << std::setprecision(0) << ", \"args\": {\"flops\": " << event.cost.flops << ", \"bytes\": " << event.cost.bytes
+                 << ", \"allocatedBytes\": " << event.allocatedBytes << ", \"allocations\": " << event.allocations << "}}";
+        }
+    }
+    file << "\n]}\n";
+}
+
+} // namespace mygrad
@@ -0,0 +1,102 @@
+#include <cmath>
+#include <array>
+#include <random>
+#include <numbers>
+#include <algorithm>
+
+#include "mygrad/random.hpp"
+#include "mygrad/threadPool.hpp"
+#include "mygrad/vectorMath.hpp"
+
+namespace mygrad {
+
+static constexpr size_t WORK_PER_BLOCK = 150; // ten rounds of philox, then a log, a square root, a sine and a cosine
+
+uint64_t randomSeed() {
+    std::random_device device;
+    return (uint64_t(device()) << 32) | device();
+}
+
+
+// (-1)^k / (2k + offset)!, the coefficients of sin x = x - x^3/3! + x^5/5! - ... over x with an offset of 1, and of
+// cos x = 1 - x^2/2! + x^4/4! - ... with 0
+template <typename T, int terms>
+static constexpr std::array<T, terms> alternatingCoefficients( int offset ) {
+    const auto factorials = vectorMath::inverseFactorials<T, 2 * terms + 1>();
+    std::array<T, terms> coefficients {};
+    for (int k = 0; k < terms; k++) coefficients[k] = (k % 2 ? -1 : 1) * factorials[2 * k + offset];
+    return coefficients;
+}
+
+// sine and cosine of 2 pi turns, for turns in [0, 1]: the quarter turns come off exactly, and within an eighth of a
+// turn of 0 short taylor series are enough. like vectorMath, only arithmetic and selects, so it's vectorized
+template <typename T>
+static inline void sinCosOfTurns( T turns, T& sine, T& cosine ) {
+    constexpr int TERMS = sizeof(T) == sizeof(float) ? 5 : 8;
+    constexpr auto sinCoefficients = alternatingCoefficients<T, TERMS>(1), cosCoefficients = alternatingCoefficients<T, TERMS>(0);
+
+    const T quarters = turns * 4;
+    const T quadrant = (quarters + vectorMath::Traits<T>::SHIFTER) - vectorMath::Traits<T>::SHIFTER; // 0 to 4
+    const T x = (quarters - quadrant) * T(std::numbers::pi / 2), x2 = x * x;
+
+    T sinSeries = 0, cosSeries = 0;
+    for (int k = TERMS - 1; k >= 0; k--) {
+        sinSeries = sinSeries * x2 + sinCoefficients[k];
+        cosSeries = cosSeries * x2 + cosCoefficients[k];
+    }
+    const T sinX = x * sinSeries, cosX = cosSeries;
+
+    // turning by a quarter takes (cos, sin) to (-sin, cos)
+    const bool odd = (quadrant == 1) | (quadrant == 3);
+    const T cosSign = (quadrant == 1) | (quadrant == 2) ? T(-1) : T(1);
+    const T sinSign = (quadrant == 2) | (quadrant == 3) ? T(-1) : T(1);
+    cosine = cosSign * (odd ? sinX : cosX);
+    sine = sinSign * (odd ? cosX : sinX);
+}
+
+// uniform in (0, 1), never 0 so the logarithm of it is finite
+static inline double uniform( uint32_t high, uint32_t low ) {
+    return (double(int32_t(high >> 5)) * 0x1p26 + double(int32_t(low >> 6)) + 0.5) * 0x1p-53;
+}
+
+static inline float uniform( uint32_t bits ) {
+    return (float(int32_t(bits >> 8)) + 0.5f) * 0x1p-24f;
+}
+
+static inline void boxMuller( dtype u1, dtype u2, dtype mean, dtype standardDeviation, dtype* output ) {
+    const dtype radius = standardDeviation * std::sqrt(-2 * vectorMath::log(u1));
+    dtype sine, cosine;
+    sinCosOfTurns(u2, sine, cosine);
+    output[0] = mean + radius * cosine;
+    output[1] = mean + radius * sine;
+}
+
+static inline void normalsOfBlock( const Philox::Block& bits, dtype mean, dtype standardDeviation, dtype* output ) {
+    if constexpr (Philox::NORMALS_PER_BLOCK == 4) {
+        boxMuller(uniform(bits[0]), uniform(bits[1]), mean, standardDeviation, output);
+        boxMuller(uniform(bits[2]), uniform(bits[3]), mean, standardDeviation, output + 2);
+    } else {
+        boxMuller(uniform(bits[0], bits[1]), uniform(bits[2], bits[3]), mean, standardDeviation, output);
+    }
+}
+
+
+void Philox::normal( dtype* output, size_t length, dtype mean, dtype standardDeviation ) {
+    const size_t fullBlocks = length / NORMALS_PER_BLOCK, rest = length % NORMALS_PER_BLOCK;
+    const uint64_t first = position, key = this->key;
+    position += fullBlocks + (rest ? 1 : 0);
+
+    parallelFor(0, fullBlocks, grainFor(WORK_PER_BLOCK), [=] (size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) {
+            normalsOfBlock(block(first + i, key), mean, standardDeviation, &output[i * NORMALS_PER_BLOCK]);
+        }
+    });
+
+    if (rest) {
+        dtype last[NORMALS_PER_BLOCK];
+        normalsOfBlock(block(first + fullBlocks, key), mean, standardDeviation, last);
+        std::copy(last, last + rest, &output[fullBlocks * NORMALS_PER_BLOCK]);
+    }
+}
+
+} // namespace mygrad
@@ -8,16 +8,27 @@
 #include "mygrad/tensor.hpp"
 
 #include "mygrad/helper.hpp"
+#include "mygrad/profiler.hpp"
+#include "mygrad/vectorMath.hpp"
 
 namespace mygrad {
 
+// zeroed memory of its own for a tensor, from the cache
+static TensorMemory allocateMemory( size_t length ) {
+    size_t capacity;
+    dtype* const memory = MemoryCache::allocate(length, capacity);
+    return TensorMemory(memory, { true, capacity });
+}
+
 Tensor::Tensor( const TensorDims& dimensions )
 try:
     length(lengthFromDimensions(dimensions)),
     dimensions(dimensions),
     strides(stridesFromDimensions(dimensions)),
-    data(std::make_unique<dtype[]>(length)),
-    grads(std::make_unique<dtype[]>(length)) {}
+    data(allocateMemory(length)),
+    grads(GradMode::enabled() ? allocateMemory(length) : nullptr) {
+        Profiler::recordAllocation((grads ? 2 : 1) * length * sizeof(dtype));
+    }
 
 catch (const std::bad_alloc& e) {
     std::cerr << "check if the dimensions provided for tensor are not too big. dimensions: \n" << dimensions;
@@ -39,10 +50,21 @@ Tensor::Tensor( const std::vector<dtype>& dataVector,
         }
     }
 
+Tensor::Tensor( const TensorDims& dimensions, TensorMemory data, TensorMemory grads ) :
+    length(lengthFromDimensions(dimensions)),
+    dimensions(dimensions),
+    strides(stridesFromDimensions(dimensions)),
+    data(std::move(data)),
+    grads(std::move(grads)) {}
+
 Tensor Tensor::zeros( const TensorDims& dimensions ) {
     return Tensor(dimensions);
 }
 
+Tensor Tensor::view( dtype* data, dtype* grads, const TensorDims& dimensions ) {
+    return Tensor(dimensions, TensorMemory(data, { false }), TensorMemory(grads, { false }));
+}
+
 
 void Tensor::print() const {
     if (dimensions.size() > 1) {
@@ -55,6 +77,7 @@ void Tensor::print() const {
 }
 
 void Tensor::printGrad() const {
+    if (!grads) throw std::runtime_error("tensor made in inference mode has no grads to print");
     if (dimensions.size() > 1) {
         printRecursively(0, 0, true, true);
     }
@@ -270,19 +293,30 @@ void Tensor::checkValidityOfDimension( int dimension ) const {
 }
 
 
+void Tensor::allocateGrads() {
+    if (grads) return;
+    grads = allocateMemory(length);
+    Profiler::recordAllocation(length * sizeof(dtype));
+}
+
+void Tensor::moveInto( dtype* newData, dtype* newGrads ) {
+    std::copy(data.get(), data.get() + length, newData);
+    if (grads) std::copy(grads.get(), grads.get() + length, newGrads);
+    else std::fill(newGrads, newGrads + length, dtype(0));
+    data = TensorMemory(newData, { false });
+    grads = TensorMemory(newGrads, { false });
+}
+
+
 Tensor Tensor::exp() const {
     Tensor expedTensor( zeros(dimensions) );
-    for (size_t i = 0; i < length; i++) {
-        expedTensor.data[i] = std::exp(data[i]);
-    }
+    vectorExp(data.get(), expedTensor.data.get(), length);
     return expedTensor;
 }
 
 Tensor Tensor::log() const {
     Tensor loggedTensor( zeros(dimensions) );
-    for (size_t i = 0; i < length; i++) {
-        loggedTensor.data[i] = std::log(data[i]);
-    }
+    vectorLog(data.get(), loggedTensor.data.get(), length);
     return loggedTensor;
 }
 
@@ -1,25 +1,357 @@
 #include "mygrad/threadPool.hpp"
+#include "mygrad/profiler.hpp"
 
-#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <stdexcept>
+
+#ifdef MYGRAD_THREAD_POOL_STATS
+#include <chrono>
+#include <bit>
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace mygrad {
 
 static constexpr size_t DEFAULT_POOL_SIZE = 8;
+static constexpr size_t LENDABLE_DEQUES = 8;         // for threads outside the pool that push jobs
+static constexpr size_t DEQUE_CAPACITY = 256;        // a power of two
+static constexpr size_t SPINS_BEFORE_YIELD = 1 << 6;  // idle rounds an idle thread busy waits through
+static constexpr size_t SPINS_BEFORE_SLEEP = 1 << 10; // idle rounds it spends before it sleeps, busy waiting then
+                                                      // yielding, so back to back layers don't pay for waking it up
+
+// one idle round: a pause at first, which keeps the wait cheap for a sibling hyperthread, then the core is given away
+static void backOff( size_t idleSpins ) {
+    if (idleSpins >= SPINS_BEFORE_YIELD) {
+        std::this_thread::yield();
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+
+// what the pool starts with, set by configure() or read from the environment
+static std::mutex settingsMutex;
+static bool poolStarted = false;
+static bool configured = false;
+static size_t configuredThreads = 0;
+static std::vector<unsigned> configuredCpus;
+
+// a list like "0-3,8,10-11"
+static std::vector<unsigned> parseCpuList( const std::string& list ) {
+    std::vector<unsigned> cpus;
+    size_t position = 0;
+    while (position < list.size()) {
+        size_t end = list.find(',', position);
+        if (end == std::string::npos) end = list.size();
+        const std::string range = list.substr(position, end - position);
+        position = end + 1;
+
+        try {
+            const size_t dash = range.find('-');
+            const unsigned first = std::stoul(range.substr(0, dash));
+            const unsigned last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            if (last < first) throw std::invalid_argument(range);
+            for (unsigned cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("MYGRAD_CPU_LIST must be a list of cpus and ranges like 0-3,8, got " + list);
+        }
+    }
+    return cpus;
+}
+
+static void readEnvironment() {
+    if (const char* threads = std::getenv("MYGRAD_NUM_THREADS"); threads and *threads) {
+        try { configuredThreads = std::stoul(threads); }
+        catch (const std::logic_error&) {
+            throw std::runtime_error(std::string("MYGRAD_NUM_THREADS must be a number, got ") + threads);
+        }
+    }
+    if (const char* cpus = std::getenv("MYGRAD_CPU_LIST"); cpus and *cpus) {
+        configuredCpus = parseCpuList(cpus);
+    }
+}
+
+// checked before any worker starts, as a constructor that throws can't take its running threads down with it
+static void checkCpus( const std::vector<unsigned>& cpus ) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    for (unsigned cpu : cpus) {
+        if (cpu >= CPU_SETSIZE or !CPU_ISSET(cpu, &allowed)) {
+            throw std::runtime_error("the thread pool can't be pinned to cpu " + std::to_string(cpu) + ", the process may not run there");
+        }
+    }
+#else
+    (void)cpus;
+#endif
+}
+
+static void pinToCpu( std::thread& thread, unsigned cpu ) {
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet);
+#else
+    (void)thread, (void)cpu;
+#endif
+}
+
+
+#ifdef MYGRAD_THREAD_POOL_STATS
+
+static constexpr size_t HISTOGRAM_BUCKETS = 40; // bucket i counts durations in [2^i, 2^(i+1)) nanoseconds
+
+static int64_t nanosecondsNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Histogram {
+    std::atomic<uint64_t> counts[HISTOGRAM_BUCKETS] {};
+
+    void add( int64_t nanoseconds ) {
+        const size_t bucket = std::bit_width(static_cast<uint64_t>(std::max<int64_t>(nanoseconds, 1))) - 1;
+        counts[std::min(bucket, HISTOGRAM_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// relaxed atomics, as the threads outside the pool all share one
+struct alignas(64) ThreadStats {
+    std::atomic<uint64_t> tasksRun {0};
+    std::atomic<uint64_t> tasksStolen {0};
+    std::atomic<int64_t> busyNanoseconds {0};     // running jobs, including whatever they wait on inside
+    std::atomic<int64_t> spinningNanoseconds {0}; // idle, busy waiting or yielding
+    std::atomic<int64_t> sleepingNanoseconds {0}; // idle, parked until a push or a completion wakes it
+    Histogram queueWait;                          // from a job's push to the start of its run
+    Histogram taskTime;
+
+    void addTo( std::atomic<int64_t>& counter, int64_t nanoseconds ) { counter.fetch_add(nanoseconds, std::memory_order_relaxed); }
+};
+
+// one per worker, then one for all the threads outside the pool
+static std::unique_ptr<ThreadStats[]> stats;
+static size_t statsWorkers = 0;
+static thread_local ThreadStats* threadStats = nullptr;
+static thread_local size_t jobDepth = 0;
+
+static ThreadStats& ownStats() { return threadStats ? *threadStats : stats[statsWorkers]; }
+
+// the idle spans of a thread between jobs, split by how it waited. waits inside a job are left to the job's busy time
+static thread_local struct IdleTimer {
+    enum class State { Working, Spinning, Sleeping } state = State::Working;
+    int64_t since = 0;
+
+    void switchTo( State next ) {
+        if (jobDepth != 0 or next == state) return;
+        const int64_t now = nanosecondsNow();
+        ThreadStats& own = ownStats();
+        if (state == State::Spinning) own.addTo(own.spinningNanoseconds, now - since);
+        if (state == State::Sleeping) own.addTo(own.sleepingNanoseconds, now - since);
+        state = next, since = now;
+    }
+} idleTimer;
+
+// load imbalance per epoch, an epoch being the work done between two waits of threads outside the pool: the busiest
+// thread's busy time over the mean, the waiting thread counting as one more, so 1 is perfectly balanced and the
+// number of threads is one thread doing everything. with several outside threads waiting at once epochs blur together
+static std::mutex epochMutex;
+static std::vector<int64_t> busyAtLastEpoch;
+static uint64_t epochs = 0;
+static double imbalanceSum = 0, worstImbalance = 0;
+
+static void endEpoch() {
+    std::lock_guard lock(epochMutex);
+    busyAtLastEpoch.resize(statsWorkers + 1, 0);
+
+    int64_t total = 0, busiest = 0;
+    for (size_t thread = 0; thread <= statsWorkers; thread++) {
+        const int64_t busy = stats[thread].busyNanoseconds.load(std::memory_order_relaxed);
+        const int64_t sinceLast = busy - std::exchange(busyAtLastEpoch[thread], busy);
+        total += sinceLast;
+        busiest = std::max(busiest, sinceLast);
+    }
+    if (total <= 0) return;
+
+    const double imbalance = static_cast<double>(busiest) * (statsWorkers + 1) / total;
+    epochs++;
+    imbalanceSum += imbalance;
+    worstImbalance = std::max(worstImbalance, imbalance);
+}
+
+static void recordPush( Task& task ) { task.pushedAt = nanosecondsNow(); }
+
+static int64_t recordJobStart( const Task& task, bool stolen ) {
+    idleTimer.switchTo(IdleTimer::State::Working);
+    jobDepth++;
+    const int64_t start = nanosecondsNow();
+    ThreadStats& own = ownStats();
+    own.queueWait.add(start - task.pushedAt);
+    if (stolen) own.tasksStolen.fetch_add(1, std::memory_order_relaxed);
+    return start;
+}
+
+static void recordJobEnd( int64_t start ) {
+    jobDepth--;
+    const int64_t elapsed = nanosecondsNow() - start;
+    ThreadStats& own = ownStats();
+    own.tasksRun.fetch_add(1, std::memory_order_relaxed);
+    own.addTo(own.busyNanoseconds, elapsed);
+    own.taskTime.add(elapsed);
+}
+
+static void recordIdle( bool sleeping ) {
+    idleTimer.switchTo(sleeping ? IdleTimer::State::Sleeping : IdleTimer::State::Spinning);
+}
+
+static void recordWaitEnd() {
+    idleTimer.switchTo(IdleTimer::State::Working);
+    if (!threadStats and jobDepth == 0) endEpoch();
+}
+
+static std::string histogramJson( const Histogram& histogram ) {
+    std::string json = "[";
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        json += (bucket ? ", " : "") + std::to_string(histogram.counts[bucket].load(std::memory_order_relaxed));
+    }
+    return json + "]";
+}
+
+static std::string threadStatsJson( const ThreadStats& thread ) {
+    auto number = [] (const auto& counter) { return std::to_string(counter.load(std::memory_order_relaxed)); };
+    return "{\"tasksRun\": " + number(thread.tasksRun)
+         + ", \"tasksStolen\": " + number(thread.tasksStolen)
+         + ", \"busyNanoseconds\": " + number(thread.busyNanoseconds)
+         + ", \"spinningNanoseconds\": " + number(thread.spinningNanoseconds)
+         + ", \"sleepingNanoseconds\": " + number(thread.sleepingNanoseconds)
+         + ", \"queueWaitNanoseconds\": " + histogramJson(thread.queueWait)
+         + ", \"taskNanoseconds\": " + histogramJson(thread.taskTime) + "}";
+}
+
+#else
+
+static void recordPush( Task& ) {}
+static int64_t recordJobStart( const Task&, bool ) { return 0; }
+static void recordJobEnd( int64_t ) {}
+static void recordIdle( bool ) {}
+static void recordWaitEnd() {}
+
+#endif
+
+
+// the Chase-Lev deque, over a fixed ring of tasks. a slot stays occupied until whichever thread took its task has
+// moved it out, so the owner can't overwrite a task that a thief is still copying. that happens before the task
+// runs, so the slot is free for the jobs the task pushes itself
+struct ThreadPool::WorkDeque {
+    struct alignas(64) Slot {
+        Task task;
+        std::atomic<bool> occupied {false};
+    };
+
+    alignas(64) std::atomic<int64_t> top {0};
+    alignas(64) std::atomic<int64_t> bottom {0};
+    std::atomic<bool> lent {false};
+    std::unique_ptr<Slot[]> slots {new Slot[DEQUE_CAPACITY]};
+
+    Slot& slotAt( int64_t position ) { return slots[position & (DEQUE_CAPACITY - 1)]; }
+
+    // owner only: the slot the next push goes to, nullptr when the ring is full
+    Task* reserve() {
+        Slot& slot = slotAt(bottom.load(std::memory_order_relaxed));
+        return slot.occupied.load(std::memory_order_acquire) ? nullptr : &slot.task;
+    }
+
+    // owner only: makes the reserved task visible to everyone
+    void publish() {
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        slotAt(b).occupied.store(true, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // owner only: takes the newest task
+    Slot* pop() {
+        const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) { // empty
+            bottom.store(b + 1, std::memory_order_release);
+            return nullptr;
+        }
+        if (t == b) { // the last task, thieves may be after it as well
+            const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_release);
+            return won ? &slotAt(b) : nullptr;
+        }
+        return &slotAt(b);
+    }
+
+    // anyone but the owner: takes the oldest task
+    Slot* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) return nullptr;
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+        return &slotAt(t);
+    }
+
+    bool empty() const {
+        return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+    }
+};
+
+
+thread_local ThreadPool::WorkDeque* ThreadPool::threadDeque = nullptr;
+
+
+ThreadPool::ThreadPool() :
+    threads(), deques(),
+    jobsRemaining(0), pushes(0), sleepers(0), completions(0), waiters(0), terminate(false), failed(false) {
+        std::lock_guard lock(settingsMutex);
+        if (!configured) readEnvironment();
+        checkCpus(configuredCpus);
+        poolStarted = true;
+
+        const size_t hardwareThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : DEFAULT_POOL_SIZE;
+        const size_t poolSize = configuredThreads ? configuredThreads
+                              : !configuredCpus.empty() ? configuredCpus.size() : hardwareThreads;
+
+        deques.reserve(poolSize + LENDABLE_DEQUES);
+        for (size_t i = 0; i < poolSize + LENDABLE_DEQUES; i++) {
+            deques.push_back(std::make_unique<WorkDeque>());
+        }
+
+#ifdef MYGRAD_THREAD_POOL_STATS
+        stats = std::make_unique<ThreadStats[]>(poolSize + 1);
+        statsWorkers = poolSize;
+#endif
 
-ThreadPool::ThreadPool() : 
-    threads(),
-    jobs(), jobsMutex(), jobsAvailable(), jobsRemaining(0) {
-        const size_t poolSize = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : DEFAULT_POOL_SIZE;
         threads.reserve(poolSize);
         for (size_t i = 0; i < poolSize; i++) {
-            threads.emplace_back(std::thread(&threadLoop));
+            threads.emplace_back(std::thread(&threadLoop, i));
+            if (!configuredCpus.empty()) pinToCpu(threads.back(), configuredCpus[i % configuredCpus.size()]);
         }
     }
 
 ThreadPool::~ThreadPool() {
+    terminate = true;
+    pushes++;
+    pushes.notify_all();
     for (size_t i = 0; i < threads.size(); i++) {
-        terminate = true;
-        jobsAvailable.notify_all();
         threads[i].join();
     }
 }
@@ -29,44 +361,230 @@ ThreadPool& ThreadPool::get() {
     return instance;
 }
 
-void ThreadPool::push(std::function<void()> job) {
+void ThreadPool::configure( size_t threads, std::vector<unsigned> cpus ) {
+    std::lock_guard lock(settingsMutex);
+    if (poolStarted) throw std::runtime_error("ThreadPool::configure must be called before the pool is first used");
+    configured = true;
+    configuredThreads = threads;
+    configuredCpus = std::move(cpus);
+}
+
+
+ThreadPool::WorkDeque* ThreadPool::ownDeque() {
+    if (threadDeque) return threadDeque;
+
+    // a thread outside the pool borrows one of the spare deques, and hands it back when it ends
+    struct DequeLease {
+        WorkDeque* deque = nullptr;
+        ~DequeLease() { if (deque) deque->lent.store(false, std::memory_order_release); }
+    };
+    static thread_local DequeLease lease;
+
+    ThreadPool& pool = get();
+    for (size_t i = pool.threads.size(); i < pool.deques.size(); i++) {
+        bool lent = false;
+        if (pool.deques[i]->lent.compare_exchange_strong(lent, true, std::memory_order_acquire)) {
+            lease.deque = threadDeque = pool.deques[i].get();
+            return threadDeque;
+        }
+    }
+    return nullptr;
+}
+
+Task* ThreadPool::reserveTask( WorkDeque* deque ) {
+    return deque ? deque->reserve() : nullptr;
+}
+
+void ThreadPool::pushTask( WorkDeque* deque ) {
     ThreadPool& pool = get();
-    std::lock_guard lock (pool.jobsMutex);
-    pool.jobs.push(job);
     pool.jobsRemaining++;
-    pool.jobsAvailable.notify_one();
+    recordPush(deque->slotAt(deque->bottom.load(std::memory_order_relaxed)).task);
+    deque->publish();
+
+    pool.pushes++;
+    if (pool.sleepers.load() > 0) pool.pushes.notify_one();
 }
 
 
-void ThreadPool::threadLoop() {
+bool ThreadPool::runOneJob( size_t firstVictim ) {
     ThreadPool& pool = get();
-    while (true) {
-        std::function<void()> job; 
-        {
-            std::unique_lock<std::mutex> lock(pool.jobsMutex);
-            pool.jobsAvailable.wait(lock, [&pool] { return !pool.jobs.empty() or pool.terminate; });
 
-            if (pool.jobs.empty() and pool.terminate) { return; }
+    // the own deque first, newest job first, then the oldest job of whichever deque has one
+    WorkDeque::Slot* slot = threadDeque ? threadDeque->pop() : nullptr;
+    const bool stolen = !slot;
+    for (size_t i = 0; !slot and i < pool.deques.size(); i++) {
+        WorkDeque* victim = pool.deques[(firstVictim + i) % pool.deques.size()].get();
+        if (victim != threadDeque) slot = victim->steal();
+    }
+    if (!slot) return false;
+
+    Task task;
+    slot->task.relocateTo(task);
+    slot->occupied.store(false, std::memory_order_release);
+
+    // the counts drop and waiting threads are woken however the job ends. the group may be gone as soon as its count
+    // drops, so it's the last thing touched
+    struct Finish {
+        ThreadPool& pool;
+        TaskGroup* group;
+        int64_t start;
+        ~Finish() {
+            recordJobEnd(start);
+            if (group) group->jobsRemaining--;
+            pool.jobsRemaining--;
 
-            job = pool.jobs.front();
-            pool.jobs.pop();
+            pool.completions++;
+            if (pool.waiters.load() > 0) pool.completions.notify_all();
         }
-        job();
+    } finish { pool, task.group, recordJobStart(task, stolen) };
 
-        if (--pool.jobsRemaining == 0) {
-            std::unique_lock lock(pool.doneMutex);
-            pool.allDone.notify_all();
+    try {
+        Profiler::Scope scope("job", "job");
+        task.run();
+    }
+    catch (...) { keepException(finish.group, std::current_exception()); }
+    return true;
+}
+
+void ThreadPool::keepException( TaskGroup* group, std::exception_ptr thrown ) {
+    if (group) {
+        group->keepException(thrown);
+        return;
+    }
+    ThreadPool& pool = get();
+    if (!pool.failed.exchange(true)) pool.exception = thrown;
+}
+
+bool ThreadPool::anyJobs() {
+    for (const auto& deque : get().deques) {
+        if (!deque->empty()) return true;
+    }
+    return false;
+}
+
+
+void ThreadPool::threadLoop( size_t worker ) {
+    ThreadPool& pool = get();
+    threadDeque = pool.deques[worker].get();
+    Profiler::nameThread("worker " + std::to_string(worker));
+#ifdef MYGRAD_THREAD_POOL_STATS
+    threadStats = &stats[worker];
+#endif
+
+    size_t idleSpins = 0;
+    while (true) {
+        if (runOneJob(worker + 1)) {
+            idleSpins = 0;
+            continue;
+        }
+        if (pool.terminate) return;
+        recordIdle(false);
+        if (++idleSpins < SPINS_BEFORE_SLEEP) {
+            backOff(idleSpins);
+            continue;
         }
+
+        // the deques are checked again after the push count is read, so a push in between can't be slept through
+        recordIdle(true);
+        pool.sleepers++;
+        const unsigned pushesSeen = pool.pushes.load();
+        if (!anyJobs() and !pool.terminate) pool.pushes.wait(pushesSeen);
+        pool.sleepers--;
+        idleSpins = 0;
     }
 }
 
+void ThreadPool::helpUntilDone( const std::atomic<size_t>& remaining ) {
+    ThreadPool& pool = get();
+
+    // the waiting thread lends a hand until there's nothing left to take, spins for a while as the last jobs are
+    // usually about to finish, then sleeps until they do. the count is checked again after the completions are read,
+    // so a job finishing in between can't be slept through
+    size_t idleSpins = 0;
+    while (remaining.load() != 0) {
+        if (runOneJob(0)) {
+            idleSpins = 0;
+            continue;
+        }
+        recordIdle(false);
+        if (++idleSpins < SPINS_BEFORE_SLEEP) {
+            backOff(idleSpins);
+            continue;
+        }
+
+        recordIdle(true);
+        pool.waiters++;
+        const unsigned completionsSeen = pool.completions.load();
+        if (remaining.load() != 0 and !anyJobs()) pool.completions.wait(completionsSeen);
+        pool.waiters--;
+        idleSpins = 0;
+    }
+    recordWaitEnd();
+}
+
 void ThreadPool::waitUntilDone() {
     ThreadPool& pool = get();
-    std::unique_lock lock(pool.doneMutex);
-    pool.allDone.wait(lock, [&pool] {
-        return pool.jobsRemaining == 0;
-    });
+    helpUntilDone(pool.jobsRemaining);
+    if (pool.failed) {
+        pool.failed = false;
+        std::rethrow_exception(std::exchange(pool.exception, nullptr));
+    }
 }
 
-} // namespace mygrad
+bool ThreadPool::busy() {
+    return get().jobsRemaining.load() != 0;
+}
+
+std::string ThreadPool::statsJson() {
+#ifdef MYGRAD_THREAD_POOL_STATS
+    get();
+    ThreadStats total;
+    std::string workers;
+    for (size_t thread = 0; thread <= statsWorkers; thread++) {
+        const ThreadStats& own = stats[thread];
+        if (thread < statsWorkers) workers += (thread ? ",\n    " : "") + threadStatsJson(own);
+
+        total.tasksRun += own.tasksRun.load(std::memory_order_relaxed);
+        total.tasksStolen += own.tasksStolen.load(std::memory_order_relaxed);
+        total.busyNanoseconds += own.busyNanoseconds.load(std::memory_order_relaxed);
+        total.spinningNanoseconds += own.spinningNanoseconds.load(std::memory_order_relaxed);
+        total.sleepingNanoseconds += own.sleepingNanoseconds.load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+            total.queueWait.counts[bucket] += own.queueWait.counts[bucket].load(std::memory_order_relaxed);
+            total.taskTime.counts[bucket] += own.taskTime.counts[bucket].load(std::memory_order_relaxed);
+        }
+    }
 
+    std::lock_guard lock(epochMutex);
+    return "{\n  \"enabled\": true,\n  \"threads\": " + std::to_string(statsWorkers)
+         + ",\n  \"epochs\": " + std::to_string(epochs)
+         + ",\n  \"meanImbalance\": " + std::to_string(epochs ? imbalanceSum / epochs : 0.0)
+         + ",\n  \"worstImbalance\": " + std::to_string(worstImbalance)
+         + ",\n  \"pool\": " + threadStatsJson(total)
+         + ",\n  \"outsideThreads\": " + threadStatsJson(stats[statsWorkers])
+         + ",\n  \"workers\": [\n    " + workers + "\n  ]\n}\n";
+#else
+    return "{\n  \"enabled\": false\n}\n";
+#endif
+}
+
+void ThreadPool::resetStats() {
+#ifdef MYGRAD_THREAD_POOL_STATS
+    get();
+    for (size_t thread = 0; thread <= statsWorkers; thread++) {
+        ThreadStats& own = stats[thread];
+        own.tasksRun = 0, own.tasksStolen = 0;
+        own.busyNanoseconds = 0, own.spinningNanoseconds = 0, own.sleepingNanoseconds = 0;
+        for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+            own.queueWait.counts[bucket] = 0;
+            own.taskTime.counts[bucket] = 0;
+        }
+    }
+
+    std::lock_guard lock(epochMutex);
+    busyAtLastEpoch.assign(statsWorkers + 1, 0);
+    epochs = 0, imbalanceSum = 0, worstImbalance = 0;
+#endif
+}
+
+} // namespace mygrad
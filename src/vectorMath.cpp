@@ -0,0 +1,26 @@
+#include "mygrad/vectorMath.hpp"
+#include "mygrad/threadPool.hpp"
+
+namespace mygrad {
+
+static constexpr size_t WORK_PER_ELEMENT = 20; // about what one of these functions costs in simple operations
+
+void vectorExp( const dtype* input, dtype* output, size_t length ) {
+    parallelFor(0, length, grainFor(WORK_PER_ELEMENT), [input, output] (size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) output[i] = vectorMath::exp(input[i]);
+    });
+}
+
+void vectorLog( const dtype* input, dtype* output, size_t length ) {
+    parallelFor(0, length, grainFor(WORK_PER_ELEMENT), [input, output] (size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) output[i] = vectorMath::log(input[i]);
+    });
+}
+
+void vectorSigmoid( const dtype* input, dtype* output, size_t length ) {
+    parallelFor(0, length, grainFor(WORK_PER_ELEMENT), [input, output] (size_t start, size_t end) {
+        for (size_t i = start; i < end; i++) output[i] = vectorMath::sigmoid(input[i]);
+    });
+}
+
+} // namespace mygrad
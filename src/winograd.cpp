@@ -0,0 +1,387 @@
+#include <cmath>
+#include <algorithm>
+
+#include "mygrad/conv2d.hpp"
+#include "mygrad/gemm.hpp"
+#include "mygrad/threadPool.hpp"
+
+// winograd F(2x2, 3x3), as in Lavin & Gray, "Fast Algorithms for Convolutional Neural Networks":
+//     output tile = A^T [ (G g G^T) .* (B^T d B) ] A
+// for a 4x4 input tile d and a 3x3 kernel g. summed over input channels, the elementwise product
+// turns into 16 independent matrix products, one per element of the transformed tile.
+// backward applies the transpose of every step in reverse order, so the grads are exact.
+
+namespace mygrad {
+
+static constexpr size_t TILE = 4, OUTPUT_TILE = 2, TRANSFORMED = TILE * TILE;
+
+// the transforms. B^T, G and A^T are
+//   1  0 -1  0      1    0    0      1  1  1  0
+//   0  1  1  0      1/2  1/2  1/2    0  1 -1 -1
+//   0 -1  1  0      1/2 -1/2  1/2
+//   0  1  0 -1      0    0    1
+
+static inline void inputTransform( const dtype (&d)[TILE][TILE], dtype (&v)[TILE][TILE] ) { // v = B^T d B
+    dtype t[TILE][TILE];
+    for (size_t j = 0; j < TILE; j++) {
+        t[0][j] = d[0][j] - d[2][j];
+        t[1][j] = d[1][j] + d[2][j];
+        t[2][j] = d[2][j] - d[1][j];
+        t[3][j] = d[1][j] - d[3][j];
+    }
+    for (size_t i = 0; i < TILE; i++) {
+        v[i][0] = t[i][0] - t[i][2];
+        v[i][1] = t[i][1] + t[i][2];
+        v[i][2] = t[i][2] - t[i][1];
+        v[i][3] = t[i][1] - t[i][3];
+    }
+}
+
+static inline void inputGradTransform( const dtype (&dv)[TILE][TILE], dtype (&dd)[TILE][TILE] ) { // dd = B dv B^T
+    dtype t[TILE][TILE];
+    for (size_t j = 0; j < TILE; j++) {
+        t[0][j] = dv[0][j];
+        t[1][j] = dv[1][j] - dv[2][j] + dv[3][j];
+        t[2][j] = dv[1][j] + dv[2][j] - dv[0][j];
+        t[3][j] = -dv[3][j];
+    }
+    for (size_t i = 0; i < TILE; i++) {
+        dd[i][0] = t[i][0];
+        dd[i][1] = t[i][1] - t[i][2] + t[i][3];
+        dd[i][2] = t[i][1] + t[i][2] - t[i][0];
+        dd[i][3] = -t[i][3];
+    }
+}
+
+static inline void kernelTransform( const dtype* g, dtype (&u)[TILE][TILE] ) { // u = G g G^T
+    dtype t[TILE][3];
+    for (size_t j = 0; j < 3; j++) {
+        t[0][j] = g[j];
+        t[1][j] = (g[j] + g[3 + j] + g[6 + j]) / 2;
+        t[2][j] = (g[j] - g[3 + j] + g[6 + j]) / 2;
+        t[3][j] = g[6 + j];
+    }
+    for (size_t i = 0; i < TILE; i++) {
+        u[i][0] = t[i][0];
+        u[i][1] = (t[i][0] + t[i][1] + t[i][2]) / 2;
+        u[i][2] = (t[i][0] - t[i][1] + t[i][2]) / 2;
+        u[i][3] = t[i][2];
+    }
+}
+
+static inline void kernelGradTransform( const dtype (&du)[TILE][TILE], dtype* dg ) { // dg += G^T du G
+    dtype t[3][TILE];
+    for (size_t j = 0; j < TILE; j++) {
+        t[0][j] = du[0][j] + (du[1][j] + du[2][j]) / 2;
+        t[1][j] = (du[1][j] - du[2][j]) / 2;
+        t[2][j] = (du[1][j] + du[2][j]) / 2 + du[3][j];
+    }
+    for (size_t i = 0; i < 3; i++) {
+        dg[3*i]     += t[i][0] + (t[i][1] + t[i][2]) / 2;
+        dg[3*i + 1] += (t[i][1] - t[i][2]) / 2;
+        dg[3*i + 2] += (t[i][1] + t[i][2]) / 2 + t[i][3];
+    }
+}
+
+static inline void outputTransform( const dtype (&m)[TILE][TILE], dtype (&y)[OUTPUT_TILE][OUTPUT_TILE] ) { // y = A^T m A
+    dtype t[OUTPUT_TILE][TILE];
+    for (size_t j = 0; j < TILE; j++) {
+        t[0][j] = m[0][j] + m[1][j] + m[2][j];
+        t[1][j] = m[1][j] - m[2][j] - m[3][j];
+    }
+    for (size_t i = 0; i < OUTPUT_TILE; i++) {
+        y[i][0] = t[i][0] + t[i][1] + t[i][2];
+        y[i][1] = t[i][1] - t[i][2] - t[i][3];
+    }
+}
+
+static inline void outputGradTransform( const dtype (&dy)[OUTPUT_TILE][OUTPUT_TILE], dtype (&dm)[TILE][TILE] ) { // dm = A dy A^T
+    dtype t[TILE][OUTPUT_TILE];
+    for (size_t j = 0; j < OUTPUT_TILE; j++) {
+        t[0][j] = dy[0][j];
+        t[1][j] = dy[0][j] + dy[1][j];
+        t[2][j] = dy[0][j] - dy[1][j];
+        t[3][j] = -dy[1][j];
+    }
+    for (size_t i = 0; i < TILE; i++) {
+        dm[i][0] = t[i][0];
+        dm[i][1] = t[i][0] + t[i][1];
+        dm[i][2] = t[i][0] - t[i][1];
+        dm[i][3] = -t[i][1];
+    }
+}
+
+
+void Conv2d::winogradForward( const Tensor& inputTensor ) {
+
+    TensorDims neededKernelDims = {TRANSFORMED, outChannels, inChannels};
+    if (!winogradKernels.fits(neededKernelDims)) winogradKernels = Tensor::zeros(neededKernelDims);
+    transformKernels();
+
+    const size_t pictures = outputTensor.dimensions[0], chunkPictures = winogradChunkPictures();
+    const size_t tilesPerPicture = ((outputTensor.dimensions[2] + 1) / OUTPUT_TILE) * ((outputTensor.dimensions[3] + 1) / OUTPUT_TILE);
+
+    for (size_t firstPicture = 0; firstPicture < pictures; firstPicture += chunkPictures) {
+        const size_t picturesInChunk = std::min(chunkPictures, pictures - firstPicture);
+
+        transformInput( inputTensor, firstPicture, picturesInChunk );
+        winogradMultiply( picturesInChunk * tilesPerPicture );
+        transformOutput( firstPicture, picturesInChunk );
+    }
+}
+
+void Conv2d::winogradBackward( Tensor& inputTensor ) {
+
+    const size_t pictures = outputTensor.dimensions[0];
+    const size_t tilesPerPicture = ((outputTensor.dimensions[2] + 1) / OUTPUT_TILE) * ((outputTensor.dimensions[3] + 1) / OUTPUT_TILE);
+    const size_t chunkPictures = winogradInput.dimensions[2] / tilesPerPicture;
+
+    for (size_t firstPicture = 0; firstPicture < pictures; firstPicture += chunkPictures) {
+        const size_t picturesInChunk = std::min(chunkPictures, pictures - firstPicture);
+
+        // with a single chunk the transformed input is still there from forward
+        if (chunkPictures < pictures) transformInput( inputTensor, firstPicture, picturesInChunk );
+
+        transformOutputGrads( firstPicture, picturesInChunk );
+        winogradMultiplyBackward( picturesInChunk * tilesPerPicture, firstPicture > 0 );
+        transformInputGrads( inputTensor, firstPicture, picturesInChunk );
+    }
+
+    transformKernelGrads();
+}
+
+
+size_t Conv2d::winogradChunkPictures() {
+
+    // like the im2col path, whole pictures of transformed tiles (and their grads, outside inference mode) are processed
+    // in chunks that fit into workspaceMemoryLimit
+    const size_t pictures = outputTensor.dimensions[0];
+    const size_t tilesPerPicture = ((outputTensor.dimensions[2] + 1) / OUTPUT_TILE) * ((outputTensor.dimensions[3] + 1) / OUTPUT_TILE);
+    const size_t bytesPerPicture = (GradMode::enabled() ? 2 : 1) * TRANSFORMED * (inChannels + outChannels) * tilesPerPicture * sizeof(dtype);
+    const size_t chunkPictures = std::clamp<size_t>(workspaceMemoryLimit / bytesPerPicture, 1, pictures);
+
+    TensorDims neededInputDims = {TRANSFORMED, inChannels, chunkPictures * tilesPerPicture};
+    TensorDims neededOutputDims = {TRANSFORMED, outChannels, chunkPictures * tilesPerPicture};
+    if (!winogradInput.fits(neededInputDims)) winogradInput = Tensor::zeros(neededInputDims);
+    if (!winogradOutput.fits(neededOutputDims)) winogradOutput = Tensor::zeros(neededOutputDims);
+
+    return chunkPictures;
+}
+
+
+void Conv2d::transformKernels() {
+    parallelFor(0, outChannels, grainFor(inChannels * TRANSFORMED), [this] (size_t startChannel, size_t endChannel) {
+        for (size_t outChannel = startChannel; outChannel < endChannel; outChannel++) {
+            for (size_t inChannel = 0; inChannel < inChannels; inChannel++) {
+                dtype u[TILE][TILE];
+                kernelTransform(&kernels.data[(outChannel * inChannels + inChannel) * 9], u);
+
+                for (size_t element = 0; element < TRANSFORMED; element++) {
+                    winogradKernels.data[(element * outChannels + outChannel) * inChannels + inChannel] = u[element / TILE][element % TILE];
+                }
+            }
+        }
+    });
+}
+
+void Conv2d::transformKernelGrads() {
+    parallelFor(0, outChannels, grainFor(inChannels * TRANSFORMED), [this] (size_t startChannel, size_t endChannel) {
+        for (size_t outChannel = startChannel; outChannel < endChannel; outChannel++) {
+            for (size_t inChannel = 0; inChannel < inChannels; inChannel++) {
+                dtype du[TILE][TILE];
+                for (size_t element = 0; element < TRANSFORMED; element++) {
+                    du[element / TILE][element % TILE] = winogradKernels.grads[(element * outChannels + outChannel) * inChannels + inChannel];
+                }
+
+                kernelGradTransform(du, &kernels.grads[(outChannel * inChannels + inChannel) * 9]);
+            }
+        }
+    });
+}
+
+
+void Conv2d::transformInput( const Tensor& inputTensor, size_t firstPicture, size_t pictures ) {
+
+    const size_t tileRows = (outputTensor.dimensions[2] + 1) / OUTPUT_TILE, tileCols = (outputTensor.dimensions[3] + 1) / OUTPUT_TILE;
+    const SourceOffsets offsets = sourceOffsets( inputTensor, tileRows * OUTPUT_TILE + TILE - OUTPUT_TILE, tileCols * OUTPUT_TILE + TILE - OUTPUT_TILE );
+    const size_t tiles = pictures * tileRows * tileCols; // the chunk's tiles are packed densely
+
+    // split by (picture, channel) planes, so a batch of one still spreads over the pool
+    parallelFor2d(pictures, inChannels, 1, 1, tileRows * tileCols * TRANSFORMED * 4,
+                  [&] (size_t startPicture, size_t endPicture, size_t startChannel, size_t endChannel) {
+        for (size_t picture = firstPicture + startPicture; picture < firstPicture + endPicture; picture++) {
+            for (size_t channel = startChannel; channel < endChannel; channel++) {
+                const dtype* channelData = &inputTensor.data[picture * inputTensor.strides[0] + channel * inputTensor.strides[1]];
+                size_t tile = (picture - firstPicture) * tileRows * tileCols;
+
+                for (size_t tileRow = 0; tileRow < tileRows; tileRow++) {
+                    for (size_t tileCol = 0; tileCol < tileCols; tileCol++, tile++) {
+                        const int* rowOffsets = &offsets.rows[tileRow * OUTPUT_TILE];
+                        const int* colOffsets = &offsets.cols[tileCol * OUTPUT_TILE];
+
+                        dtype d[TILE][TILE];
+                        for (size_t i = 0; i < TILE; i++) {
+                            for (size_t j = 0; j < TILE; j++) {
+                                d[i][j] = (rowOffsets[i] >= 0 and colOffsets[j] >= 0) ? channelData[rowOffsets[i] + colOffsets[j]] : 0;
+                            }
+                        }
+
+                        dtype v[TILE][TILE];
+                        inputTransform(d, v);
+                        for (size_t element = 0; element < TRANSFORMED; element++) {
+                            winogradInput.data[(element * inChannels + channel) * tiles + tile] = v[element / TILE][element % TILE];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+void Conv2d::transformInputGrads( Tensor& inputTensor, size_t firstPicture, size_t pictures ) {
+
+    // tiles overlap (and with upsampling, several tile pixels share an input pixel), but only within a plane,
+    // so splitting by planes keeps every input grad with one writer
+    const size_t tileRows = (outputTensor.dimensions[2] + 1) / OUTPUT_TILE, tileCols = (outputTensor.dimensions[3] + 1) / OUTPUT_TILE;
+    const SourceOffsets offsets = sourceOffsets( inputTensor, tileRows * OUTPUT_TILE + TILE - OUTPUT_TILE, tileCols * OUTPUT_TILE + TILE - OUTPUT_TILE );
+    const size_t tiles = pictures * tileRows * tileCols; // the chunk's tiles are packed densely
+
+    parallelFor2d(pictures, inChannels, 1, 1, tileRows * tileCols * TRANSFORMED * 4,
+                  [&] (size_t startPicture, size_t endPicture, size_t startChannel, size_t endChannel) {
+        for (size_t picture = firstPicture + startPicture; picture < firstPicture + endPicture; picture++) {
+            for (size_t channel = startChannel; channel < endChannel; channel++) {
+                dtype* channelGrads = &inputTensor.grads[picture * inputTensor.strides[0] + channel * inputTensor.strides[1]];
+                size_t tile = (picture - firstPicture) * tileRows * tileCols;
+
+                for (size_t tileRow = 0; tileRow < tileRows; tileRow++) {
+                    for (size_t tileCol = 0; tileCol < tileCols; tileCol++, tile++) {
+                        const int* rowOffsets = &offsets.rows[tileRow * OUTPUT_TILE];
+                        const int* colOffsets = &offsets.cols[tileCol * OUTPUT_TILE];
+
+                        dtype dv[TILE][TILE];
+                        for (size_t element = 0; element < TRANSFORMED; element++) {
+                            dv[element / TILE][element % TILE] = winogradInput.grads[(element * inChannels + channel) * tiles + tile];
+                        }
+
+                        dtype dd[TILE][TILE];
+                        inputGradTransform(dv, dd);
+                        for (size_t i = 0; i < TILE; i++) {
+                            for (size_t j = 0; j < TILE; j++) {
+                                if (rowOffsets[i] >= 0 and colOffsets[j] >= 0) {
+                                    channelGrads[rowOffsets[i] + colOffsets[j]] += dd[i][j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+
+void Conv2d::transformOutput( size_t firstPicture, size_t pictures ) {
+
+    const size_t outputRows = outputTensor.dimensions[2], outputCols = outputTensor.dimensions[3];
+    const size_t tileRows = (outputRows + 1) / OUTPUT_TILE, tileCols = (outputCols + 1) / OUTPUT_TILE;
+    const size_t tiles = pictures * tileRows * tileCols;
+
+    parallelFor2d(pictures, outChannels, 1, 1, tileRows * tileCols * TRANSFORMED * 4,
+                  [&] (size_t startPicture, size_t endPicture, size_t startChannel, size_t endChannel) {
+        for (size_t picture = firstPicture + startPicture; picture < firstPicture + endPicture; picture++) {
+            for (size_t channel = startChannel; channel < endChannel; channel++) {
+                dtype* channelData = &outputTensor.data[picture * outputTensor.strides[0] + channel * outputTensor.strides[1]];
+                size_t tile = (picture - firstPicture) * tileRows * tileCols;
+
+                for (size_t tileRow = 0; tileRow < tileRows; tileRow++) {
+                    for (size_t tileCol = 0; tileCol < tileCols; tileCol++, tile++) {
+
+                        dtype m[TILE][TILE];
+                        for (size_t element = 0; element < TRANSFORMED; element++) {
+                            m[element / TILE][element % TILE] = winogradOutput.data[(element * outChannels + channel) * tiles + tile];
+                        }
+
+                        dtype y[OUTPUT_TILE][OUTPUT_TILE];
+                        outputTransform(m, y);
+                        for (size_t i = 0; i < OUTPUT_TILE; i++) {
+                            for (size_t j = 0; j < OUTPUT_TILE; j++) {
+                                const size_t row = tileRow * OUTPUT_TILE + i, col = tileCol * OUTPUT_TILE + j;
+                                if (row < outputRows and col < outputCols) {
+                                    channelData[row * outputCols + col] = activate(activation, y[i][j] + biases.data[channel]);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+void Conv2d::transformOutputGrads( size_t firstPicture, size_t pictures ) {
+
+    const size_t outputRows = outputTensor.dimensions[2], outputCols = outputTensor.dimensions[3];
+    const size_t tileRows = (outputRows + 1) / OUTPUT_TILE, tileCols = (outputCols + 1) / OUTPUT_TILE;
+    const size_t tiles = pictures * tileRows * tileCols;
+
+    parallelFor2d(pictures, outChannels, 1, 1, tileRows * tileCols * TRANSFORMED * 4,
+                  [&] (size_t startPicture, size_t endPicture, size_t startChannel, size_t endChannel) {
+        for (size_t picture = firstPicture + startPicture; picture < firstPicture + endPicture; picture++) {
+            for (size_t channel = startChannel; channel < endChannel; channel++) {
+                const dtype* channelGrads = &outputTensor.grads[picture * outputTensor.strides[0] + channel * outputTensor.strides[1]];
+                size_t tile = (picture - firstPicture) * tileRows * tileCols;
+
+                for (size_t tileRow = 0; tileRow < tileRows; tileRow++) {
+                    for (size_t tileCol = 0; tileCol < tileCols; tileCol++, tile++) {
+
+                        dtype dy[OUTPUT_TILE][OUTPUT_TILE];
+                        for (size_t i = 0; i < OUTPUT_TILE; i++) {
+                            for (size_t j = 0; j < OUTPUT_TILE; j++) {
+                                const size_t row = tileRow * OUTPUT_TILE + i, col = tileCol * OUTPUT_TILE + j;
+                                dy[i][j] = (row < outputRows and col < outputCols) ? channelGrads[row * outputCols + col] : 0;
+                            }
+                        }
+
+                        dtype dm[TILE][TILE];
+                        outputGradTransform(dy, dm);
+                        for (size_t element = 0; element < TRANSFORMED; element++) {
+                            winogradOutput.grads[(element * outChannels + channel) * tiles + tile] = dm[element / TILE][element % TILE];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+
+void Conv2d::winogradMultiply( size_t tiles ) {
+    for (size_t element = 0; element < TRANSFORMED; element++) {
+        // output[element] = kernels[element] * input[element]
+        gemm( Transpose::No, Transpose::No, outChannels, tiles, inChannels,
+              &winogradKernels.data[element * outChannels * inChannels], inChannels,
+              &winogradInput.data[element * inChannels * tiles], tiles,
+              &winogradOutput.data[element * outChannels * tiles], tiles,
+              false );
+    }
+}
+
+void Conv2d::winogradMultiplyBackward( size_t tiles, bool accumulateKernelGrads ) {
+    for (size_t element = 0; element < TRANSFORMED; element++) {
+        // kernel grads[element] (+)= output grads[element] * input[element]^T
+        gemm( Transpose::No, Transpose::Yes, outChannels, inChannels, tiles,
+              &winogradOutput.grads[element * outChannels * tiles], tiles,
+              &winogradInput.data[element * inChannels * tiles], tiles,
+              &winogradKernels.grads[element * outChannels * inChannels], inChannels,
+              accumulateKernelGrads );
+
+        // input grads[element] = kernels[element]^T * output grads[element]
+        gemm( Transpose::Yes, Transpose::No, inChannels, tiles, outChannels,
+              &winogradKernels.data[element * outChannels * inChannels], inChannels,
+              &winogradOutput.grads[element * outChannels * tiles], tiles,
+              &winogradInput.grads[element * inChannels * tiles], tiles,
+              false );
+    }
+}
+
+} // namespace mygrad